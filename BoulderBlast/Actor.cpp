@@ -1,14 +1,24 @@
 #include "Actor.h"
 #include "GameConstants.h"
+#include <algorithm>
 
 //===============================================================================================
 // Actor
 //===============================================================================================
 
 Actor::Actor(StudentWorld* studentWorld, int imageID, int startX, int startY, bool isVisible, GraphObject::Direction dir)
-: GraphObject(imageID, startX, startY, dir), m_studentWorld(studentWorld)
+: GraphObject(imageID, startX, startY, dir), m_studentWorld(studentWorld), m_handle(studentWorld->registerActor(this)),
+m_id(0), m_hashContribution(0)
 {
-	setVisible(isVisible);
+	//The actor only becomes part of the state hash once the world adds it via updateHash()
+	GraphObject::setVisible(isVisible);
+}
+
+Actor::~Actor()
+{
+	//Take this actor out of the state hash and invalidate all handles that still refer to it
+	m_studentWorld->toggleStateHash(m_hashContribution);
+	m_studentWorld->unregisterActor(m_handle);
 }
 
 StudentWorld* Actor::getStudentWorld() const
@@ -16,6 +26,79 @@ StudentWorld* Actor::getStudentWorld() const
 	return m_studentWorld;
 }
 
+ActorHandle Actor::getHandle() const
+{
+	return m_handle;
+}
+
+void Actor::saveState(ActorState& state) const
+{
+	//Store everything every actor has, derived classes add their own data on top of this
+	state.handleIndex = m_handle.index;
+	state.handleGeneration = m_handle.generation;
+	state.imageID = static_cast<short>(getID());
+	state.x = static_cast<short>(getX());
+	state.y = static_cast<short>(getY());
+	state.direction = static_cast<unsigned char>(getDirection());
+	state.flags = isVisible() ? ActorState::VISIBLE : 0;
+	state.hp = 0;
+	for (int i = 0; i < 4; i++)
+		state.typeState[i] = 0;
+	state.id = m_id;
+}
+
+void Actor::moveTo(int x, int y)
+{
+	int oldX = getX(), oldY = getY();
+	GraphObject::moveTo(x, y);
+	m_studentWorld->actorMoved(this, oldX, oldY);
+	updateHash();
+}
+
+void Actor::setDirection(GraphObject::Direction d)
+{
+	GraphObject::setDirection(d);
+	updateHash();
+}
+
+void Actor::setVisible(bool shouldIDisplay)
+{
+	//A hole that is filled or an exit that is revealed changes the renderer's background layer
+	if (shouldIDisplay != isVisible() && StudentWorld::isBackgroundImage(getID()))
+		m_studentWorld->backgroundChanged();
+	GraphObject::setVisible(shouldIDisplay);
+	updateHash();
+}
+
+void Actor::updateHash()
+{
+	//Mix everything the actor would store in a snapshot, except for its handle, into one key
+	//and swap the old key for the new one in the world's hash
+	ActorState state;
+	saveState(state);
+	unsigned long long fields[] = {
+		static_cast<unsigned long long>(state.imageID) << 48 | static_cast<unsigned long long>(state.x & 0xffff) << 32 |
+			static_cast<unsigned long long>(state.y & 0xffff) << 16 | state.direction << 8 | state.flags,
+		static_cast<unsigned int>(state.hp),
+		static_cast<unsigned long long>(static_cast<unsigned int>(state.typeState[0])) << 32 | static_cast<unsigned int>(state.typeState[1]),
+		static_cast<unsigned long long>(static_cast<unsigned int>(state.typeState[2])) << 32 | static_cast<unsigned int>(state.typeState[3])
+	};
+	unsigned long long key = 0;
+	for (int i = 0; i < 4; i++)
+		key = mixHash(key ^ fields[i]);
+
+	m_studentWorld->toggleStateHash(m_hashContribution ^ key);
+	m_hashContribution = key;
+}
+
+void Actor::loadState(const ActorState& state)
+{
+	//Position and type were already used to construct the actor
+	m_id = state.id;
+	setDirection(static_cast<GraphObject::Direction>(state.direction));
+	setVisible((state.flags & ActorState::VISIBLE) != 0);
+}
+
 //===============================================================================================
 // DestructableActor
 //===============================================================================================
@@ -28,6 +111,7 @@ int DestructableActor::getHp() const
 void DestructableActor::setHp(int hp)
 {
 	 m_hp = hp;
+	 updateHash();
 }
 
 bool DestructableActor::isAlive() const
@@ -41,9 +125,25 @@ void DestructableActor::setDead()
 	setVisible(false);
 }
 
+void DestructableActor::saveState(ActorState& state) const
+{
+	Actor::saveState(state);
+	state.hp = m_hp;
+	if (m_isAlive)
+		state.flags |= ActorState::ALIVE;
+}
+
+void DestructableActor::loadState(const ActorState& state)
+{
+	Actor::loadState(state);
+	m_hp = state.hp;
+	m_isAlive = (state.flags & ActorState::ALIVE) != 0;
+}
+
 void DestructableActor::isAttacked()
 {
 	m_hp -= 2;
+	updateHash();
 	if (m_hp <= 0)
 		setDead();
 }
@@ -55,14 +155,14 @@ bool DestructableActor::offsetCoordinatesInDirection(int &x, int &y, GraphObject
 	switch (dir)
 	{
 	case GraphObject::up:
-		if (y + 1 < VIEW_WIDTH)
+		if (getStudentWorld()->isOnBoard(x, y + 1))
 		{
 			y++;
 			hasSucceeded = true;
 		}
 		break;
 	case GraphObject::right:
-		if (x + 1 < VIEW_HEIGHT)
+		if (getStudentWorld()->isOnBoard(x + 1, y))
 		{
 			x++;
 			hasSucceeded = true;
@@ -116,6 +216,7 @@ void Player::doSomething()
 			if (m_ammunition > 0)
 			{
 				m_ammunition--;
+				updateHash();
 				if (offsetCoordinatesInDirection(x, y, getDirection()))
 					getStudentWorld()->insertActor(new Bullet(getStudentWorld(), x, y, getDirection()));
 				getStudentWorld()->playSound(SOUND_PLAYER_FIRE);
@@ -189,6 +290,19 @@ int Player::getAmmunition() const
 void Player::increaseAmmunition(int amount)
 {
 	m_ammunition += amount;
+	updateHash();
+}
+
+void Player::saveState(ActorState& state) const
+{
+	DestructableActor::saveState(state);
+	state.typeState[0] = m_ammunition;
+}
+
+void Player::loadState(const ActorState& state)
+{
+	DestructableActor::loadState(state);
+	m_ammunition = state.typeState[0];
 }
 
 //===============================================================================================
@@ -430,10 +544,11 @@ int Robot::getCurrentTick() const
 bool Robot::incCurrentTick()
 {
 	//If currentTick is one, robot should do something and currentTicks should be incremented
+	bool shouldAct = false;
 	if (m_currentTick == 1)
 	{
 		m_currentTick++;
-		return true;
+		shouldAct = true;
 	}
 	//if currentTick is at maxTicks, set it back to 1
 	else if (m_currentTick == m_maxTicks)
@@ -442,8 +557,10 @@ bool Robot::incCurrentTick()
 	else
 		m_currentTick++;
 
+	updateHash();
+
 	//if it was not 1, the robot should not do anything
-	return false;
+	return shouldAct;
 }
 
 bool Robot::fieldContainsObstruction(int x, int y, bool forBullet) const
@@ -547,22 +664,45 @@ bool Robot::isCurrentlyFacingPlayer() const
 
 bool Robot::attack() const
 {
-	//If the robot is in the same row/column as the player and is facing it without any obstructions
-	Player* player = getStudentWorld()->getPlayer();
-	if (((player->getY() == getY() && (getDirection() == GraphObject::right || getDirection() == GraphObject::left)) ||
-		(player->getX() == getY() && (getDirection() == GraphObject::down || getDirection() == GraphObject::up))) &&
-		isCurrentlyFacingPlayer())
+	//If the robot can see the player, fire a bullet to attack it
+	if (canAttack())
 	{
-		//fire bullet to attack the player
-		int x = getX(), y = getY();
-		if (offsetCoordinatesInDirection(x, y, getDirection()))
-			getStudentWorld()->insertActor(new Bullet(getStudentWorld(), x, y, getDirection()));
-		getStudentWorld()->playSound(SOUND_ENEMY_FIRE);
+		fire();
 		return true;
 	}
 	return false;
 }
 
+bool Robot::canAttack() const
+{
+	//If the robot is in the same row/column as the player and is facing it without any obstructions
+	Player* player = getStudentWorld()->getPlayer();
+	return ((player->getY() == getY() && (getDirection() == GraphObject::right || getDirection() == GraphObject::left)) ||
+		(player->getX() == getY() && (getDirection() == GraphObject::down || getDirection() == GraphObject::up))) &&
+		isCurrentlyFacingPlayer();
+}
+
+void Robot::fire() const
+{
+	int x = getX(), y = getY();
+	if (offsetCoordinatesInDirection(x, y, getDirection()))
+		getStudentWorld()->insertActor(new Bullet(getStudentWorld(), x, y, getDirection()));
+	getStudentWorld()->playSound(SOUND_ENEMY_FIRE);
+}
+
+void Robot::saveState(ActorState& state) const
+{
+	DestructableActor::saveState(state);
+	state.typeState[0] = m_currentTick;
+}
+
+void Robot::loadState(const ActorState& state)
+{
+	//m_maxTicks only depends on the level, which the constructor has already taken care of
+	DestructableActor::loadState(state);
+	m_currentTick = state.typeState[0];
+}
+
 void Robot::isAttacked()
 {
 	//"Attack" the robot
@@ -594,14 +734,68 @@ void SnarlBot::doSomething()
 		if (!fieldContainsObstruction(x, y, false))
 			moveTo(x, y);
 		//otherwise reverse direction
-		else if (getDirection() == GraphObject::right)
-			setDirection(GraphObject::left);
-		else if (getDirection() == GraphObject::left)
-			setDirection(GraphObject::right);
-		else if (getDirection() == GraphObject::up)
-			setDirection(GraphObject::down);
-		else if (getDirection() == GraphObject::down)
-			setDirection(GraphObject::up);
+		else
+			turnAround();
+	}
+}
+
+void SnarlBot::turnAround()
+{
+	if (getDirection() == GraphObject::right)
+		setDirection(GraphObject::left);
+	else if (getDirection() == GraphObject::left)
+		setDirection(GraphObject::right);
+	else if (getDirection() == GraphObject::up)
+		setDirection(GraphObject::down);
+	else if (getDirection() == GraphObject::down)
+		setDirection(GraphObject::up);
+}
+
+void SnarlBot::planTick(Intent& intent) const
+{
+	//Same decisions as doSomething, taken against the world as it was at the start of the tick
+	intent.type = Intent::none;
+	intent.isLocal = true;
+	if (!isAlive() || getCurrentTick() != 1)
+		return;
+
+	int x = getX(), y = getY();
+	if (canAttack())
+	{
+		intent.type = Intent::fire;
+		intent.isLocal = false;
+	}
+	else if (offsetCoordinatesInDirection(x, y, getDirection()))
+	{
+		intent.type = fieldContainsObstruction(x, y, false) ? Intent::turn : Intent::move;
+		intent.x = x;
+		intent.y = y;
+	}
+}
+
+void SnarlBot::resolveTick(const Intent& intent)
+{
+	//Every living robot counts the tick, only the ones whose turn it is planned anything
+	if (!isAlive() || !incCurrentTick())
+		return;
+
+	switch (intent.type)
+	{
+	case Intent::fire:
+		fire();
+		break;
+	case Intent::move:
+		//If another robot took the field since, turn around as if it had been there all along
+		if (!fieldContainsObstruction(intent.x, intent.y, false))
+			moveTo(intent.x, intent.y);
+		else
+			turnAround();
+		break;
+	case Intent::turn:
+		turnAround();
+		break;
+	default:
+		break;
 	}
 }
 
@@ -647,19 +841,10 @@ void KleptoBot::doSomething()
 				//if there is, pick it up with a chance of 1 out of 10
 				if (g != nullptr && dynamic_cast<Jewel*>(g) == nullptr)
 				{
-					int randInt = rand() % 10;
+					int randInt = getStudentWorld()->randInt(10);
 					if (randInt == 0)
 					{
-						//Store which goodie was picked up, to create it again later
-						if (dynamic_cast<ExtraLifeGoodie*>(g) != nullptr)
-							m_goodie = "ExtraLifeGoodie";
-						else if (dynamic_cast<AmmoGoodie*>(g) != nullptr)
-							m_goodie = "AmmoGoodie";
-						else if (dynamic_cast<RestoreHealthGoodie*>(g) != nullptr)
-							m_goodie = "RestoreHealthGoodie";
-						//destroy goodie and play appropriate sound
-						g->isAttacked();
-						getStudentWorld()->playSound(SOUND_ROBOT_MUNCH);
+						pickUp(g);
 						return;
 					}
 				}
@@ -676,13 +861,14 @@ void KleptoBot::doSomething()
 		{
 			moveTo(x, y);
 			m_noOfMoves++;
+			updateHash();
 			return;
 		}
 	}
 
 	//Otherwise generate a new movingDistance and a random direction
-	m_movingDistance = 1 + (rand() % 6);
-	int dirRandInt = rand() % 4;
+	m_movingDistance = 1 + getStudentWorld()->randInt(6);
+	int dirRandInt = getStudentWorld()->randInt(4);
 	GraphObject::Direction dir = getDirectionFromInt(dirRandInt);
 	int randInts[4];
 	randInts[0] = dirRandInt;
@@ -699,6 +885,7 @@ void KleptoBot::doSomething()
 			setDirection(dir);
 			moveTo(x, y);
 			m_noOfMoves++;
+			updateHash();
 			return;
 		}
 
@@ -710,7 +897,7 @@ void KleptoBot::doSomething()
 		while (true)
 		{
 			//Create random integer between 0 and 3
-			dirRandInt = rand() % 4;
+			dirRandInt = getStudentWorld()->randInt(4);
 			bool existsAlready = false;
 			//check if it has already been used
 			for (int j = 0; j < nRandInts; j++)
@@ -731,6 +918,134 @@ void KleptoBot::doSomething()
 	setDirection(getDirectionFromInt(randInts[0]));
 }
 
+void KleptoBot::pickUp(Goodie* g)
+{
+	//Store which goodie was picked up, to create it again later
+	if (dynamic_cast<ExtraLifeGoodie*>(g) != nullptr)
+		m_goodie = "ExtraLifeGoodie";
+	else if (dynamic_cast<AmmoGoodie*>(g) != nullptr)
+		m_goodie = "AmmoGoodie";
+	else if (dynamic_cast<RestoreHealthGoodie*>(g) != nullptr)
+		m_goodie = "RestoreHealthGoodie";
+	updateHash();
+	//destroy goodie and play appropriate sound
+	g->isAttacked();
+	getStudentWorld()->playSound(SOUND_ROBOT_MUNCH);
+}
+
+void KleptoBot::planTick(Intent& intent) const
+{
+	//Same decisions as doSomething, taken against the world as it was at the start of the tick
+	//and with random numbers that belong to this robot alone
+	intent.type = Intent::none;
+	intent.value = 0;
+	intent.isLocal = true;
+	if (!isAlive() || getCurrentTick() != 1)
+		return;
+
+	//attack, if the player is in sight and this is an AngryKleptoBot
+	if (isArmed() && canAttack())
+	{
+		intent.type = Intent::fire;
+		intent.isLocal = false;
+		return;
+	}
+
+	StudentWorld* studentWorld = getStudentWorld();
+	int nDraws = 0;
+	int x = getX(), y = getY();
+
+	//If it has not picked up a goodie yet, pick up any other than a jewel with a chance of 1 out of 10
+	if (m_goodie.empty())
+	{
+		list<Actor*> actorsFound = studentWorld->getActorsAt(x, y);
+		for (list<Actor*>::iterator i = actorsFound.begin(); i != actorsFound.end(); i++)
+		{
+			Goodie* g = dynamic_cast<Goodie*>(*i);
+			if (g != nullptr && dynamic_cast<Jewel*>(g) == nullptr &&
+				studentWorld->randIntFor(this, nDraws++, 10) == 0)
+			{
+				intent.type = Intent::munch;
+				intent.target = g->getHandle();
+				intent.isLocal = false;
+				return;
+			}
+		}
+	}
+
+	//If the robot has not moved movingDistance yet and the field in front is free, move there
+	if (m_noOfMoves < m_movingDistance && offsetCoordinatesInDirection(x, y, getDirection()) &&
+		!fieldContainsObstruction(x, y, false))
+	{
+		intent.type = Intent::move;
+		intent.x = x;
+		intent.y = y;
+		intent.direction = getDirection();
+		return;
+	}
+
+	//Otherwise pick a new movingDistance and try all directions in a random order
+	intent.value = 1 + studentWorld->randIntFor(this, nDraws++, 6);
+	int order[4] = { 0, 1, 2, 3 };
+	for (int i = 3; i > 0; i--)
+		swap(order[i], order[studentWorld->randIntFor(this, nDraws++, i + 1)]);
+
+	for (int i = 0; i < 4; i++)
+	{
+		GraphObject::Direction dir = getDirectionFromInt(order[i]);
+		x = getX(), y = getY();
+		if (offsetCoordinatesInDirection(x, y, dir) && !fieldContainsObstruction(x, y, false))
+		{
+			intent.type = Intent::move;
+			intent.x = x;
+			intent.y = y;
+			intent.direction = dir;
+			return;
+		}
+	}
+
+	//in case no direction works, turn to the first random one
+	intent.type = Intent::turn;
+	intent.direction = getDirectionFromInt(order[0]);
+}
+
+void KleptoBot::resolveTick(const Intent& intent)
+{
+	//Every living robot counts the tick, only the ones whose turn it is planned anything
+	if (!isAlive() || !incCurrentTick())
+		return;
+
+	switch (intent.type)
+	{
+	case Intent::fire:
+		fire();
+		break;
+	case Intent::munch:
+	{
+		//Another KleptoBot on the same field may have picked the goodie up first
+		Goodie* g = dynamic_cast<Goodie*>(getStudentWorld()->getActor(intent.target));
+		if (g != nullptr && g->isAlive())
+			pickUp(g);
+		break;
+	}
+	case Intent::move:
+	case Intent::turn:
+		if (intent.value != 0)
+			m_movingDistance = intent.value;
+		setDirection(static_cast<GraphObject::Direction>(intent.direction));
+		//If another robot took the field since, stay, but face where it wanted to go
+		if (intent.type == Intent::move && !fieldContainsObstruction(intent.x, intent.y, false))
+		{
+			moveTo(intent.x, intent.y);
+			m_noOfMoves++;
+		}
+		updateHash();
+		break;
+	default:
+		break;
+	}
+}
+
 void KleptoBot::isAttacked()
 {
 	//"Attack KleptoBot"
@@ -756,7 +1071,47 @@ void KleptoBot::isAttacked()
 	}
 }
 
-GraphObject::Direction KleptoBot::getDirectionFromInt(int dirInt)
+void KleptoBot::saveState(ActorState& state) const
+{
+	Robot::saveState(state);
+	state.typeState[1] = m_movingDistance;
+	state.typeState[2] = m_noOfMoves;
+
+	//Store the goodie that was picked up by its image ID
+	if (m_goodie == "ExtraLifeGoodie")
+		state.typeState[3] = IID_EXTRA_LIFE;
+	else if (m_goodie == "AmmoGoodie")
+		state.typeState[3] = IID_AMMO;
+	else if (m_goodie == "RestoreHealthGoodie")
+		state.typeState[3] = IID_RESTORE_HEALTH;
+	else
+		state.typeState[3] = -1;
+}
+
+void KleptoBot::loadState(const ActorState& state)
+{
+	Robot::loadState(state);
+	m_movingDistance = state.typeState[1];
+	m_noOfMoves = state.typeState[2];
+
+	switch (state.typeState[3])
+	{
+	case IID_EXTRA_LIFE:
+		m_goodie = "ExtraLifeGoodie";
+		break;
+	case IID_AMMO:
+		m_goodie = "AmmoGoodie";
+		break;
+	case IID_RESTORE_HEALTH:
+		m_goodie = "RestoreHealthGoodie";
+		break;
+	default:
+		m_goodie = "";
+		break;
+	}
+}
+
+GraphObject::Direction KleptoBot::getDirectionFromInt(int dirInt) const
 {
 	//Create an arbitrary direction from integers 0 through 3
 	switch (dirInt)
@@ -797,20 +1152,21 @@ void AngryKleptoBot::isAttacked()
 
 void KleptoBotFactory::doSomething()
 {
-	int botCount = 0;
+	//If less than 3 bots are around and there is no one on the same field as the factory
+	if (mayProduce())
+	{
+		//Create a random number from 0 to 49
+		int randInt = getStudentWorld()->randInt(50);
+		//If it happens to be 0 (approx. 2% chance)
+		if (randInt == 0)
+			produceKleptoBot(0);
+	}
+}
 
+bool KleptoBotFactory::mayProduce() const
+{
 	//Count bots in a radius of 3 around this factory
-	for (int x = getX() - 3; x <= getX() + 3; x++)
-		if (x >= 0 && x < VIEW_WIDTH)
-			for (int y = getY() - 3; y <= getY() + 3; y++)
-				if (y >= 0 && y < VIEW_HEIGHT)
-				{
-					list<Actor*> actorsFound = getStudentWorld()->getActorsAt(x, y);
-					if (!actorsFound.empty())
-						for (list<Actor*>::iterator i = actorsFound.begin(); i != actorsFound.end(); i++)
-							if (dynamic_cast<KleptoBot*>(*i) != nullptr)
-								botCount++;
-				}
+	int botCount = getStudentWorld()->countKleptoBotsNear(getX(), getY(), 3);
 
 	bool botOnTheSameField = false;
 
@@ -821,26 +1177,48 @@ void KleptoBotFactory::doSomething()
 			if (dynamic_cast<KleptoBot*>(*i) != nullptr)
 				botOnTheSameField = true;
 
-	//If less than 3 bots were counted and there is no one on the same field as the factory
-	if (botCount < 3 && !botOnTheSameField)
+	return botCount < 3 && !botOnTheSameField;
+}
+
+void KleptoBotFactory::produceKleptoBot(int movingDistance)
+{
+	//Produce the new type of kleptoBot that should be produced by this factory
+	Actor* newKleptoBot;
+	if (m_producesAngryKleptoBots)
 	{
-		//Create a random number from 0 to 49
-		int randInt = rand() % 50;
-		//If it happens to be 0 (approx. 2% chance)
-		if (randInt == 0)
-		{
-			//Produce the new type of kleptoBot that should be produced by this factory
-			Actor* newKleptoBot;
-			if (m_producesAngryKleptoBots)
-			{
-				newKleptoBot = new AngryKleptoBot(getStudentWorld(), getX(), getY());
-			}
-			else
-			{
-				newKleptoBot = new KleptoBot(getStudentWorld(), getX(), getY());
-			}
-			getStudentWorld()->insertActor(newKleptoBot);
-			getStudentWorld()->playSound(SOUND_ROBOT_BORN);
-		}
+		newKleptoBot = new AngryKleptoBot(getStudentWorld(), getX(), getY(), movingDistance);
+	}
+	else
+	{
+		newKleptoBot = new KleptoBot(getStudentWorld(), getX(), getY(), false, movingDistance);
+	}
+	getStudentWorld()->insertActor(newKleptoBot);
+	getStudentWorld()->playSound(SOUND_ROBOT_BORN);
+}
+
+void KleptoBotFactory::planTick(Intent& intent) const
+{
+	//Counting the bots around is what costs, so that is done while planning, with the bots as
+	//they were at the start of the tick
+	intent.type = Intent::none;
+	intent.isLocal = true;
+	if (mayProduce() && getStudentWorld()->randIntFor(this, 0, 50) == 0)
+	{
+		//The new KleptoBot's first movingDistance comes from the factory's stream as well
+		intent.type = Intent::spawn;
+		intent.value = 1 + getStudentWorld()->randIntFor(this, 1, 6);
+		intent.isLocal = false;
 	}
+}
+
+void KleptoBotFactory::resolveTick(const Intent& intent)
+{
+	if (intent.type == Intent::spawn)
+		produceKleptoBot(intent.value);
+}
+void KleptoBotFactory::saveState(ActorState& state) const
+{
+	//The type of robots produced is passed to the constructor when the factory is restored
+	Actor::saveState(state);
+	state.typeState[0] = m_producesAngryKleptoBots ? 1 : 0;
 }
\ No newline at end of file
@@ -4,22 +4,77 @@
 #include "GraphObject.h"
 #include "StudentWorld.h"
 
+//Fixed size record that describes one actor inside a snapshot of the StudentWorld
+struct ActorState
+{
+	unsigned int	handleIndex;
+	unsigned int	handleGeneration;
+	short			imageID;
+	short			x;
+	short			y;
+	unsigned char	direction;
+	unsigned char	flags;
+	int				hp;
+	int				typeState[4];	//meaning depends on the type of the actor
+	unsigned long long	id;
+
+	static const unsigned char VISIBLE	= 1;
+	static const unsigned char ALIVE	= 2;
+};
+
 class Actor :public GraphObject
 {
 public:
 	Actor(StudentWorld* studentWorld, int imageID, int startX, int startY, bool isVisible = true, GraphObject::Direction dir = GraphObject::none);
-	virtual ~Actor() {}
+	virtual ~Actor();
 	virtual void doSomething() {};
 	StudentWorld* getStudentWorld() const;
+	ActorHandle getHandle() const;
+
+	//Identity that, unlike the handle, does not depend on the order actors were created in, the
+	//world sets it when it adds the actor
+	unsigned long long getId() const { return m_id; }
+	void setId(unsigned long long id) { m_id = id; }
+
+	virtual void saveState(ActorState& state) const;
+	virtual void loadState(const ActorState& state);
+
+	//Static actors never do anything, so the world does not ask them to during a tick
+	virtual bool isStatic() const { return false; }
+
+	//Actors that are no longer alive are removed at the end of the tick. Asking an actor is far
+	//cheaper than casting every actor of every tick to DestructableActor first.
+	virtual bool isAlive() const { return true; }
+
+	//Two-phase tick: planTick may only read the world, since many actors plan at once on different
+	//threads, resolveTick then carries the intent out. Actors that do not plan simply do their
+	//whole doSomething when they are resolved, after every actor before them in tick order.
+	virtual void planTick(Intent& intent) const
+	{
+		intent.type = Intent::none;
+		intent.isLocal = false;
+	}
+	virtual void resolveTick(const Intent& /* intent */) { doSomething(); }
+
+	//These hide GraphObject's versions, so that every change to an actor also updates its
+	//contribution to the state hash of the world
+	void moveTo(int x, int y);
+	void setDirection(GraphObject::Direction d);
+	void setVisible(bool shouldIDisplay);
+	void updateHash();
 
 private:
 	StudentWorld* m_studentWorld;
+	ActorHandle m_handle;
+	unsigned long long m_id;
+	unsigned long long m_hashContribution;
 };
 
 class Wall :public Actor
 {
 public:
 	Wall(StudentWorld* studentWorld, int startX, int startY) : Actor(studentWorld, IID_WALL, startX, startY) {}
+	virtual bool isStatic() const { return true; }
 };
 
 class DestructableActor : public Actor
@@ -29,11 +84,14 @@ public:
 		: Actor(studentWorld, imageID, startX, startY, true, dir), m_hp(hp), m_isAlive(true) {}
 	int getHp() const;
 	void setHp(int hp);
-	bool isAlive() const;
+	virtual bool isAlive() const;
 	void setDead();
 	bool offsetCoordinatesInDirection(int &x, int &y, GraphObject::Direction dir) const;
 	virtual void isAttacked();
 
+	virtual void saveState(ActorState& state) const;
+	virtual void loadState(const ActorState& state);
+
 private:
 	int m_hp;
 	bool m_isAlive;
@@ -48,6 +106,9 @@ public:
 	int getAmmunition() const;
 	void increaseAmmunition(int amount);
 
+	virtual void saveState(ActorState& state) const;
+	virtual void loadState(const ActorState& state);
+
 private:
 	int m_ammunition;
 };
@@ -132,6 +193,10 @@ public:
 
 	virtual void doSomething() = 0;
 	virtual bool attack() const;
+	//Whether this kind of robot shoots at the player it faces
+	virtual bool isArmed() const { return true; }
+	bool canAttack() const;
+	void fire() const;
 	
 	int getCurrentTick() const;
 	bool incCurrentTick();
@@ -141,6 +206,9 @@ public:
 
 	virtual void isAttacked();
 
+	virtual void saveState(ActorState& state) const;
+	virtual void loadState(const ActorState& state);
+
 private:
 	int m_currentTick;
 	int m_maxTicks;
@@ -153,20 +221,35 @@ public:
 		: Robot(studentWorld, IID_SNARLBOT, startX, startY, 10, dir) {}
 	virtual void doSomething();
 	virtual void isAttacked();
+
+	virtual void planTick(Intent& intent) const;
+	virtual void resolveTick(const Intent& intent);
+
+private:
+	void turnAround();
 };
 
 class KleptoBot : public Robot
 {
 public:
-	KleptoBot(StudentWorld* studentWorld, int startX, int startY, bool isForAngryKleptoBot = false)
+	//Without a movingDistance the first one is drawn from the world's random numbers
+	KleptoBot(StudentWorld* studentWorld, int startX, int startY, bool isForAngryKleptoBot = false, int movingDistance = 0)
 		: Robot(studentWorld, isForAngryKleptoBot ? IID_ANGRY_KLEPTOBOT : IID_KLEPTOBOT, startX, startY, isForAngryKleptoBot ? 8 : 5, GraphObject::right),
-		m_movingDistance(1 + (rand() % 6)), m_noOfMoves(0), m_goodie("") {}
+		m_movingDistance(movingDistance > 0 ? movingDistance : 1 + studentWorld->randInt(6)), m_noOfMoves(0), m_goodie("") {}
 	virtual void doSomething();
 	virtual bool attack() { return false; }
+	virtual bool isArmed() const { return false; }
 	virtual void isAttacked();
 
+	virtual void planTick(Intent& intent) const;
+	virtual void resolveTick(const Intent& intent);
+
+	virtual void saveState(ActorState& state) const;
+	virtual void loadState(const ActorState& state);
+
 private:
-	GraphObject::Direction getDirectionFromInt(int dirInt);
+	GraphObject::Direction getDirectionFromInt(int dirInt) const;
+	void pickUp(Goodie* g);
 
 private:
 	int m_movingDistance;
@@ -177,9 +260,10 @@ private:
 class AngryKleptoBot : public KleptoBot
 {
 public:
-	AngryKleptoBot(StudentWorld* studentWorld, int startX, int startY)
-		: KleptoBot(studentWorld, startX, startY, true) {}
+	AngryKleptoBot(StudentWorld* studentWorld, int startX, int startY, int movingDistance = 0)
+		: KleptoBot(studentWorld, startX, startY, true, movingDistance) {}
 	virtual bool attack() { return Robot::attack(); };
+	virtual bool isArmed() const { return true; }
 	virtual void isAttacked();
 };
 
@@ -191,6 +275,15 @@ public:
 		: Actor(studentWorld, IID_ROBOT_FACTORY, startX, startY), m_producesAngryKleptoBots(producesAngryKleptoBots) {}
 	virtual void doSomething();
 
+	virtual void planTick(Intent& intent) const;
+	virtual void resolveTick(const Intent& intent);
+
+	virtual void saveState(ActorState& state) const;
+
+private:
+	bool mayProduce() const;
+	void produceKleptoBot(int movingDistance);
+
 private:
 	bool m_producesAngryKleptoBots;
 };
@@ -0,0 +1,33 @@
+#ifndef ACTORHANDLE_H_
+#define ACTORHANDLE_H_
+
+//A handle refers to an actor through the index of its slot in the StudentWorld's actor table
+//and the generation that slot had when the actor was registered. Every time a slot is freed its
+//generation is increased, so a handle to an actor that has been deleted can never resolve to
+//whatever actor reuses that slot later on.
+struct ActorHandle
+{
+	unsigned int index;
+	unsigned int generation;
+
+	ActorHandle() : index(0), generation(0) {}
+	ActorHandle(unsigned int idx, unsigned int gen) : index(idx), generation(gen) {}
+
+	//generation 0 is never handed out by the world, so it marks a handle that refers to nothing
+	bool isValid() const
+	{
+		return generation != 0;
+	}
+
+	bool operator==(const ActorHandle& other) const
+	{
+		return index == other.index && generation == other.generation;
+	}
+
+	bool operator!=(const ActorHandle& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+#endif // ACTORHANDLE_H_
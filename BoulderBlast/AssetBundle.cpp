@@ -0,0 +1,156 @@
+#include "AssetBundle.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+	const char BUNDLE_MAGIC[4] = { 'B', 'B', 'A', '1' };
+
+	//Opened by main while the game is still single threaded, only read afterwards
+	AssetBundle g_shared;
+}
+
+AssetBundle::AssetBundle()
+	: m_file(), m_index(nullptr), m_nFiles(0)
+{
+}
+
+AssetBundle& AssetBundle::getShared()
+{
+	return g_shared;
+}
+
+bool AssetBundle::open(const string& filename)
+{
+	close();
+	if (!m_file.open(filename))
+		return false;
+
+	//Check everything the index claims before trusting any of it
+	Header header;
+	if (m_file.getSize() < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, m_file.getData(), sizeof(header));
+	if (memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 ||
+		header.nFiles > (m_file.getSize() - sizeof(header)) / sizeof(IndexEntry))
+	{
+		close();
+		return false;
+	}
+
+	const IndexEntry* index = reinterpret_cast<const IndexEntry*>(m_file.getData() + sizeof(header));
+	for (unsigned int i = 0; i < header.nFiles; i++)
+	{
+		if (index[i].name[MAX_NAME_LENGTH] != '\0' || index[i].offset > m_file.getSize() ||
+			index[i].size > m_file.getSize() - index[i].offset ||
+			(i > 0 && strcmp(index[i - 1].name, index[i].name) >= 0))
+		{
+			close();
+			return false;
+		}
+	}
+
+	m_index = index;
+	m_nFiles = header.nFiles;
+	m_file.prefetch();
+	return true;
+}
+
+void AssetBundle::close()
+{
+	m_file.close();
+	m_index = nullptr;
+	m_nFiles = 0;
+}
+
+bool AssetBundle::find(const string& name, const char*& data, size_t& size) const
+{
+	if (m_index == nullptr)
+		return false;
+
+	const IndexEntry* end = m_index + m_nFiles;
+	const IndexEntry* entry = lower_bound(m_index, end, name,
+		[](const IndexEntry& entry, const string& name) { return name.compare(entry.name) > 0; });
+	if (entry == end || name != entry->name)
+		return false;
+
+	data = m_file.getData() + entry->offset;
+	size = static_cast<size_t>(entry->size);
+	return true;
+}
+
+void AssetBundle::Writer::add(const string& name, const vector<char>& contents)
+{
+	m_names.push_back(name);
+	m_contents.push_back(contents);
+}
+
+bool AssetBundle::Writer::addFile(const string& name, const string& filename)
+{
+	ifstream file(filename.c_str(), ios::in | ios::binary);
+	if (!file)
+		return false;
+
+	vector<char> contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if (file.bad())
+		return false;
+	add(name, contents);
+	return true;
+}
+
+bool AssetBundle::Writer::write(const string& filename) const
+{
+	//The index is sorted by name, so finding a file is a binary search
+	vector<size_t> order(m_names.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		if (m_names[i].empty() || m_names[i].size() > MAX_NAME_LENGTH)
+			return false;
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_names[a] < m_names[b]; });
+	for (size_t i = 1; i < order.size(); i++)
+		if (m_names[order[i - 1]] == m_names[order[i]])
+			return false;
+
+	Header header;
+	memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+	header.nFiles = static_cast<unsigned int>(m_names.size());
+
+	vector<IndexEntry> index(m_names.size());
+	unsigned long long offset = sizeof(header) + index.size() * sizeof(IndexEntry);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const vector<char>& contents = m_contents[order[i]];
+		offset = (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+		memset(index[i].name, 0, sizeof(index[i].name));
+		memcpy(index[i].name, m_names[order[i]].c_str(), m_names[order[i]].size());
+		index[i].offset = offset;
+		index[i].size = contents.size();
+		offset += contents.size();
+	}
+
+	ofstream file(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!file)
+		return false;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!index.empty())
+		file.write(reinterpret_cast<const char*>(&index[0]), index.size() * sizeof(IndexEntry));
+
+	const char padding[FILE_ALIGNMENT] = { 0 };
+	unsigned long long written = sizeof(header) + index.size() * sizeof(IndexEntry);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const vector<char>& contents = m_contents[order[i]];
+		file.write(padding, static_cast<streamsize>(index[i].offset - written));
+		if (!contents.empty())
+			file.write(&contents[0], contents.size());
+		written = index[i].offset + contents.size();
+	}
+	return static_cast<bool>(file);
+}
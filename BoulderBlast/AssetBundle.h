@@ -0,0 +1,73 @@
+#ifndef ASSETBUNDLE_H_
+#define ASSETBUNDLE_H_
+
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//One file that holds the sprite atlas, the sound clips and the level files, written ahead of time
+//with --bundle. It is mapped into memory at startup and read in one go, and the loaders get
+//pointers straight into the mapping instead of opening and copying files of their own.
+class AssetBundle
+{
+public:
+	AssetBundle();
+
+	bool open(const std::string& filename);
+	void close();
+
+	bool isOpen() const
+	{
+		return m_index != nullptr;
+	}
+
+	//Finds the file called name, data then points into the mapping for as long as it is open
+	bool find(const std::string& name, const char*& data, size_t& size) const;
+
+	//The bundle the game loads its assets from. main opens it before anything is loaded, without
+	//one every asset is read from its own file.
+	static AssetBundle& getShared();
+
+	//Collects files in memory and writes them as a bundle
+	class Writer
+	{
+	public:
+		void add(const std::string& name, const std::vector<char>& contents);
+		bool addFile(const std::string& name, const std::string& filename);
+		bool write(const std::string& filename) const;
+
+	private:
+		std::vector<std::string> m_names;
+		std::vector<std::vector<char> > m_contents;
+	};
+
+private:
+	//The file starts with a header and an index sorted by name, each file's contents are aligned
+	//to FILE_ALIGNMENT bytes
+	static const unsigned int MAX_NAME_LENGTH = 47;
+	static const unsigned int FILE_ALIGNMENT = 16;
+
+	struct Header
+	{
+		char magic[4];
+		unsigned int nFiles;
+	};
+
+	struct IndexEntry
+	{
+		char name[MAX_NAME_LENGTH + 1];
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	AssetBundle(const AssetBundle&);
+	AssetBundle& operator=(const AssetBundle&);
+
+private:
+	MappedFile m_file;
+	const IndexEntry* m_index;
+	unsigned int m_nFiles;
+};
+
+#endif // ASSETBUNDLE_H_
@@ -0,0 +1,70 @@
+#ifndef BOARDGRID_H_
+#define BOARDGRID_H_
+
+#include <vector>
+#include <algorithm>
+
+//Marks the end of a list of actors on a field
+const unsigned int NO_SLOT = 0xffffffff;
+
+//The first slot of the list of actors on every field of a board, or NO_SLOT for an empty field.
+//The dimensions are set when it is reset, for the shipped 15x15 boards as for any other size.
+class BoardGrid
+{
+public:
+	BoardGrid() : m_width(0), m_height(0), m_cells() {}
+
+	void reset(int width, int height)
+	{
+		m_width = width;
+		m_height = height;
+		m_cells.assign(static_cast<size_t>(width) * height, NO_SLOT);
+	}
+
+	int getWidth() const
+	{
+		return m_width;
+	}
+
+	int getHeight() const
+	{
+		return m_height;
+	}
+
+	bool contains(int x, int y) const
+	{
+		//A negative coordinate becomes a huge unsigned one, so one comparison per axis is enough
+		return static_cast<unsigned int>(x) < static_cast<unsigned int>(m_width) &&
+			static_cast<unsigned int>(y) < static_cast<unsigned int>(m_height);
+	}
+
+	unsigned int* getCell(int x, int y)
+	{
+		return contains(x, y) ? &m_cells[static_cast<size_t>(y) * m_width + x] : nullptr;
+	}
+
+	//Calls visit with the first slot of every non-empty field in the rectangle from x0, y0 to
+	//x1, y1, clipped to the board
+	template<class Visitor>
+	void forEachCell(int x0, int y0, int x1, int y1, Visitor visit) const
+	{
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, m_width - 1);
+		y1 = std::min(y1, m_height - 1);
+		for (int y = y0; y <= y1; y++)
+		{
+			const unsigned int* row = &m_cells[static_cast<size_t>(y) * m_width];
+			for (int x = x0; x <= x1; x++)
+				if (row[x] != NO_SLOT)
+					visit(row[x]);
+		}
+	}
+
+private:
+	int m_width;
+	int m_height;
+	std::vector<unsigned int> m_cells;
+};
+
+#endif // BOARDGRID_H_
@@ -0,0 +1,44 @@
+#ifndef COUNTERRNG_H_
+#define COUNTERRNG_H_
+
+//Counter-based random numbers after Philox4x32-10 (Salmon et al., "Parallel random numbers: as
+//easy as 1, 2, 3"). Every number is a pure function of a 64-bit key and a 128-bit counter, so
+//each actor can draw from its own stream in any order and on any thread without sharing state.
+
+inline void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int out[4])
+{
+	const unsigned int M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+	const unsigned int W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+	unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	unsigned int k0 = key[0], k1 = key[1];
+	for (int round = 0; round < 10; round++)
+	{
+		unsigned long long p0 = static_cast<unsigned long long>(M0) * c0;
+		unsigned long long p1 = static_cast<unsigned long long>(M1) * c2;
+		unsigned int hi0 = static_cast<unsigned int>(p0 >> 32), lo0 = static_cast<unsigned int>(p0);
+		unsigned int hi1 = static_cast<unsigned int>(p1 >> 32), lo1 = static_cast<unsigned int>(p1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += W0;
+		k1 += W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+//Random number in [0, limit) for the drawIndex-th draw of stream streamId during tick tick
+inline int counterRandInt(unsigned long long seed, unsigned int tick, unsigned long long streamId, unsigned int drawIndex, int limit)
+{
+	unsigned int key[2] = { static_cast<unsigned int>(seed), static_cast<unsigned int>(seed >> 32) };
+	unsigned int counter[4] = { tick, drawIndex, static_cast<unsigned int>(streamId), static_cast<unsigned int>(streamId >> 32) };
+	unsigned int out[4];
+	philox4x32(counter, key, out);
+	return static_cast<int>(out[0] % static_cast<unsigned int>(limit));
+}
+
+#endif // COUNTERRNG_H_
@@ -44,7 +44,7 @@ const int KEY_PRESS_DOWN	= 1003;
 const int KEY_PRESS_SPACE	= ' ';
 const int KEY_PRESS_ESCAPE	= '\x1b';
 
-// board dimensions 
+// default board dimensions, for levels without a size header
 
 const int VIEW_WIDTH	= 15;
 const int VIEW_HEIGHT	= 15;
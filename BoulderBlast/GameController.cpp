@@ -5,11 +5,19 @@
 #include "GraphObject.h"
 #include "SoundFX.h"
 #include "SpriteManager.h"
+#include "SoftwareRenderer.h"
+#include "VideoWriter.h"
+#include "TaskScheduler.h"
+#include "AssetBundle.h"
 #include <string>
 #include <map>
 #include <utility>
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
 using namespace std;
 
 #if !defined(unix)
@@ -40,6 +48,13 @@ static const double SCORE_Z = -10;
 
 static const double PI = 4 * atan(1.0);
 
+  // A line of text for the stroke font, measured once and kept until the text changes
+struct StrokeLine
+{
+	std::string  text;
+	GLfloat      width;
+};
+
 struct SpriteInfo
 {
 	unsigned int imageID;
@@ -47,69 +62,154 @@ struct SpriteInfo
 	std::string  tgaFileName;
 };
 
-static void convertToGlutCoords(double x, double y, double& gx, double& gy, double& gz);
-static void drawPrompt(string mainMessage, string secondMessage);
-static void drawScoreAndLives(string);
+struct SoundInfo
+{
+	int			soundID;
+	const char*	fileName;
+};
+
+static void convertToGlutCoords(double x, double y, int viewWidth, int viewHeight, double& gx, double& gy, double& gz);
+static void drawPrompt(const string& mainMessage, const string& secondMessage);
+static void drawScoreAndLives(const string& gameStatText);
+
+  // Every frame of every sprite, shared by the OpenGL and the software renderer
+static const SpriteInfo SPRITES[] = {
+	{ IID_PLAYER			, 0, "dude_1.tga" },
+	{ IID_PLAYER			, 1, "dude_2.tga" },
+	{ IID_PLAYER			, 2, "dude_3.tga" },
+	{ IID_KLEPTOBOT			, 0, "kleptobot-1.tga" },
+	{ IID_KLEPTOBOT			, 1, "kleptobot-2.tga" },
+	{ IID_KLEPTOBOT			, 2, "kleptobot-3.tga" },
+	{ IID_ANGRY_KLEPTOBOT	, 0, "kleptobot-1.tga" },
+	{ IID_ANGRY_KLEPTOBOT	, 1, "kleptobot-2.tga" },
+	{ IID_ANGRY_KLEPTOBOT	, 2, "kleptobot-3.tga" },
+	{ IID_SNARLBOT			, 0, "snarlbot-1.tga"  },
+	{ IID_SNARLBOT			, 1, "snarlbot-2.tga" },
+	{ IID_SNARLBOT			, 2, "snarlbot-3.tga" },
+	{ IID_SNARLBOT			, 3, "snarlbot-4.tga" },
+	{ IID_BULLET			, 0, "bullet.tga" },
+	{ IID_ROBOT_FACTORY		, 0, "factory.tga" },
+	{ IID_JEWEL				, 0, "jewel.tga" }, 
+	{ IID_RESTORE_HEALTH	, 0, "medkit.tga" },
+	{ IID_EXTRA_LIFE		, 0, "extralife.tga" },
+	{ IID_AMMO				, 0, "ammo.tga" },
+	{ IID_EXIT				, 0, "exit.tga" },
+	{ IID_WALL				, 0, "wall.tga" },
+	{ IID_BOULDER			, 0, "boulder.tga" },
+	{ IID_HOLE				, 0, "hole.tga" }
+};
+
+static const SoundInfo SOUNDS[] = {
+	{ SOUND_THEME			, "theme.wav" },
+	{ SOUND_PLAYER_FIRE		, "torpedo.wav" },
+	{ SOUND_ENEMY_FIRE		, "pop.wav" },
+	{ SOUND_ROBOT_DIE		, "explode.wav" },
+	{ SOUND_PLAYER_DIE		, "die.wav" },
+	{ SOUND_GOT_GOODIE		, "goodie.wav" },
+	{ SOUND_REVEAL_EXIT		, "revealexit.wav" },
+	{ SOUND_FINISHED_LEVEL	, "finished.wav" },
+	{ SOUND_ROBOT_IMPACT	, "clank.wav" },
+	{ SOUND_PLAYER_IMPACT	, "ouch.wav" },
+	{ SOUND_ROBOT_MUNCH		, "munch.wav" },
+	{ SOUND_ROBOT_BORN		, "materialize.wav" },
+};
+
+  // Name of the sprite atlas in the asset bundle
+static const char* const ATLAS_FILE_NAME = "sprites.atlas";
+
+  // Decodes every TGA file once, all of them at the same time on the shared scheduler,
+  // then hands the frames to loader.addSprite() in the order of SPRITES. Returns false
+  // if one cannot be loaded.
+template<class SpriteLoader>
+static bool loadSprites(const string& assetDir, SpriteLoader& loader)
+{
+	string path = assetDir;
+	if (!path.empty())
+		path += '/';
+
+	  // frames that show the same file, like those of both kinds of KleptoBot, share it
+	const size_t nSprites = sizeof(SPRITES)/sizeof(SPRITES[0]);
+	vector<string> files;
+	vector<size_t> fileOfSprite(nSprites);
+	for (size_t k = 0; k < nSprites; k++)
+	{
+		fileOfSprite[k] = find(files.begin(), files.end(), SPRITES[k].tgaFileName) - files.begin();
+		if (fileOfSprite[k] == files.size())
+			files.push_back(SPRITES[k].tgaFileName);
+	}
+
+	vector<SpriteImage> images(files.size());
+	vector<char> isLoaded(files.size(), 0);
+	TaskScheduler::getShared().parallelFor(0, files.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			isLoaded[i] = loadTga(path + files[i], images[i]);
+	});
+
+	for (size_t k = 0; k < nSprites; k++)
+	{
+	    const SpriteInfo& d = SPRITES[k];
+		if (!isLoaded[fileOfSprite[k]] || !loader.addSprite(images[fileOfSprite[k]], d.imageID, d.frameNum))
+			return false;
+	}
+	return true;
+}
 
 void GameController::initDrawersAndSounds()
 {
-	SpriteInfo drawers[] = {
-		{ IID_PLAYER			, 0, "dude_1.tga" },
-		{ IID_PLAYER			, 1, "dude_2.tga" },
-		{ IID_PLAYER			, 2, "dude_3.tga" },
-		{ IID_KLEPTOBOT			, 0, "kleptobot-1.tga" },
-		{ IID_KLEPTOBOT			, 1, "kleptobot-2.tga" },
-		{ IID_KLEPTOBOT			, 2, "kleptobot-3.tga" },
-		{ IID_ANGRY_KLEPTOBOT	, 0, "kleptobot-1.tga" },
-		{ IID_ANGRY_KLEPTOBOT	, 1, "kleptobot-2.tga" },
-		{ IID_ANGRY_KLEPTOBOT	, 2, "kleptobot-3.tga" },
-		{ IID_SNARLBOT			, 0, "snarlbot-1.tga"  },
-		{ IID_SNARLBOT			, 1, "snarlbot-2.tga" },
-		{ IID_SNARLBOT			, 2, "snarlbot-3.tga" },
-		{ IID_SNARLBOT			, 3, "snarlbot-4.tga" },
-		{ IID_BULLET			, 0, "bullet.tga" },
-		{ IID_ROBOT_FACTORY		, 0, "factory.tga" },
-		{ IID_JEWEL				, 0, "jewel.tga" }, 
-		{ IID_RESTORE_HEALTH	, 0, "medkit.tga" },
-		{ IID_EXTRA_LIFE		, 0, "extralife.tga" },
-		{ IID_AMMO				, 0, "ammo.tga" },
-		{ IID_EXIT				, 0, "exit.tga" },
-		{ IID_WALL				, 0, "wall.tga" },
-		{ IID_BOULDER			, 0, "boulder.tga" },
-		{ IID_HOLE				, 0, "hole.tga" }
-	};
-
-	SoundMapType::value_type sounds[] = {
-		make_pair(SOUND_THEME			, "theme.wav"),
-		make_pair(SOUND_PLAYER_FIRE		, "torpedo.wav"),
-		make_pair(SOUND_ENEMY_FIRE		, "pop.wav"),
-		make_pair(SOUND_ROBOT_DIE		, "explode.wav"),
-		make_pair(SOUND_PLAYER_DIE		, "die.wav"),
-		make_pair(SOUND_GOT_GOODIE		, "goodie.wav"),
-		make_pair(SOUND_REVEAL_EXIT		, "revealexit.wav"),
-		make_pair(SOUND_FINISHED_LEVEL	, "finished.wav"),
-		make_pair(SOUND_ROBOT_IMPACT	, "clank.wav"),
-		make_pair(SOUND_PLAYER_IMPACT	, "ouch.wav"),
-		make_pair(SOUND_ROBOT_MUNCH		, "munch.wav"),
-		make_pair(SOUND_ROBOT_BORN		, "materialize.wav"),
-	};
-	
-	for (int k = 0; k < sizeof(drawers)/sizeof(drawers[0]); k++)
+	string path = m_gw->assetDirectory();
+	if (!path.empty())
+		path += '/';
+
+	  // With an asset bundle the atlas and its mipmaps go to OpenGL as they are, and
+	  // the sounds are played from the bundle's memory
+	const AssetBundle& bundle = AssetBundle::getShared();
+	const char* data;
+	size_t size;
+	if (!bundle.find(ATLAS_FILE_NAME, data, size) || !m_spriteManager.loadAtlas(data, size))
 	{
-		string path = m_gw->assetDirectory();
-		if (!path.empty())
-			path += '/';
-	    const SpriteInfo& d = drawers[k];
-		if (!m_spriteManager.loadSprite(path + d.tgaFileName, d.imageID, d.frameNum))
+		if (!loadSprites(m_gw->assetDirectory(), m_spriteManager) || !m_spriteManager.buildAtlas())
 			exit(0);
 	}
-	for (int k = 0; k < sizeof(sounds)/sizeof(sounds[0]); k++)
-		m_soundMap[sounds[k].first] = sounds[k].second;
+	for (size_t k = 0; k < sizeof(SOUNDS)/sizeof(SOUNDS[0]); k++)
+	{
+		m_soundMap[SOUNDS[k].soundID] = SOUNDS[k].fileName;
+		if (bundle.find(SOUNDS[k].fileName, data, size))
+			SoundFX().addClip(path + SOUNDS[k].fileName, data, size);
+	}
 }
 
-static void doSomethingCallback()
+bool GameController::writeAssetBundle(const string& assetDir, const string& filename)
 {
-	Game().doSomething();
+	string path = assetDir;
+	if (!path.empty())
+		path += '/';
+
+	AssetBundle::Writer writer;
+	SpriteManager atlas;
+	vector<char> atlasData;
+	if (!loadSprites(assetDir, atlas) || !atlas.writeAtlas(atlasData))
+		return false;
+	writer.add(ATLAS_FILE_NAME, atlasData);
+
+	for (size_t k = 0; k < sizeof(SOUNDS)/sizeof(SOUNDS[0]); k++)
+		if (!writer.addFile(SOUNDS[k].fileName, path + SOUNDS[k].fileName))
+			return false;
+
+	  // every one of level00.dat to level99.dat there is
+	for (int k = 0; k <= 99; k++)
+	{
+		ostringstream name;
+		name << "level" << setw(2) << setfill('0') << k << ".dat";
+		if (ifstream((path + name.str()).c_str()) && !writer.addFile(name.str(), path + name.str()))
+			return false;
+	}
+	return writer.write(filename);
+}
+
+static void renderCallback()
+{
+	Game().render();
 }
 
 static void reshapeCallback(int w, int h)
@@ -129,7 +229,7 @@ static void specialKeyboardEventCallback(int key, int x, int y)
 
 static void timerFuncCallback(int val)
 {
-	Game().doSomething();
+	Game().render();
 	glutTimerFunc(MS_PER_FRAME, timerFuncCallback, 0);
 }
 
@@ -143,6 +243,13 @@ void GameController::run(GameWorld* gw, string windowTitle)
 	m_curIntraFrameTick = 0;
 	m_playerWon = false;
 
+	if (m_replayMode == replay_record)
+	{
+		m_replay = &m_recording;
+		m_replay->startRecording(gw->getRandomState(), gw->getLevel(), gw->getTickThreads() != 0,
+								 gw->getResidentChunkLimit());
+	}
+
 	glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
 	glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT); 
 	glutInitWindowPosition(0, 0); 
@@ -153,12 +260,164 @@ void GameController::run(GameWorld* gw, string windowTitle)
 	glutKeyboardFunc(keyboardEventCallback);
 	glutSpecialFunc(specialKeyboardEventCallback);
 	glutReshapeFunc(reshapeCallback);
-	glutDisplayFunc(doSomethingCallback);
+	glutDisplayFunc(renderCallback);
 	glutTimerFunc(MS_PER_FRAME, timerFuncCallback, 0);
 
+	  // The world is only ever touched by the simulation thread from here on
+	m_simulation = thread(&GameController::runSimulation, this);
+
 	glutMainLoop(); 
 }
 
+void GameController::runSimulation()
+{
+	  // Steps at a pace of its own, however long the renderer takes for a frame. After a
+	  // step that took too long it carries on from now rather than rushing to catch up.
+	m_simulationThreadId = this_thread::get_id();
+	chrono::steady_clock::time_point nextStep = chrono::steady_clock::now();
+	while (!m_quitRequested)
+	{
+		doSomething();
+		nextStep += chrono::milliseconds(MS_PER_FRAME);
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (nextStep < now)
+			nextStep = now;
+		else
+			this_thread::sleep_until(nextStep);
+	}
+	m_simulationDone = true;
+}
+
+bool GameController::playReplay(GameWorld* gw, Replay& replay, ReplayResult& result)
+{
+	gw->setController(this);
+	m_gw = gw;
+	  // without frames to draw, the world need not keep its HUD text up to date either
+	m_headless = m_framePrefix.empty() && m_videoFile.empty();
+	m_replayMode = replay_play;
+	m_replay = &replay;
+
+	  // Frames are drawn in software, there may be no display at all. The video is
+	  // written by a thread of its own while the replay goes on.
+	SoftwareRenderer renderer(WINDOW_WIDTH, WINDOW_HEIGHT);
+	RenderSnapshot snapshot;
+	VideoWriter video;
+	bool isRendering = !m_headless && loadSprites(gw->assetDirectory(), renderer);
+	if (isRendering && !m_videoFile.empty())
+		isRendering = video.open(m_videoFile, WINDOW_WIDTH, WINDOW_HEIGHT, 1000 / MS_PER_FRAME, m_frameStep);
+	unsigned int nFrames = 0;
+
+	  // The world must tick the way it did during the recording. How many threads the
+	  // two-phase tick uses does not change its results.
+	gw->setTickThreads(replay.isTwoPhaseTick() ? max(gw->getTickThreads(), 1u) : 0);
+	gw->setResidentChunkLimit(replay.getResidentChunkLimit());
+	gw->setRandomSeed(replay.getSeed());
+	while (gw->getLevel() < replay.getStartLevel())
+		gw->advanceToNextLevel();
+
+	  // Same sequence of init/move/cleanUp calls as the interactive state machine,
+	  // minus the prompts and animation frames in between
+	replay.startPlayback();
+	m_quitRequested = false;
+	result.ticks = 0;
+	result.restoresMatched = true;
+	vector<char> blob;
+	bool completed = false;
+	bool needsNewLevel = false;
+	int status = gw->init();
+	while (status == GWSTATUS_CONTINUE_GAME)
+	{
+		if (!replay.playTick())
+		{
+			completed = true;
+			break;
+		}
+		if (needsNewLevel)
+		{
+			gw->cleanUp();
+			status = gw->init();
+			needsNewLevel = false;
+			if (status != GWSTATUS_CONTINUE_GAME)
+				break;
+		}
+
+		status = gw->move();
+		result.ticks++;
+		  // the recording stopped after the tick in which 'q' was pressed
+		if (m_quitRequested)
+			break;
+
+		  // a restored world must be the same one and go on exactly as the recording did
+		if (m_restoreCheckInterval != 0 && status == GWSTATUS_CONTINUE_GAME && result.ticks % m_restoreCheckInterval == 0)
+		{
+			unsigned long long stateHash = gw->getStateHash();
+			gw->snapshot(blob);
+			if (!gw->restore(blob) || gw->getStateHash() != stateHash)
+				result.restoresMatched = false;
+		}
+
+		  // the same frames the animate state shows after each move
+		  // (every one of them moves the objects on, even if it is not drawn)
+		for (int k = 0; isRendering && k <= ANIMATION_POSITIONS_PER_TICK; k++)
+		{
+			fillGamePlaySnapshot(snapshot);
+			if (nFrames++ % m_frameStep != 0)
+				continue;
+
+			renderer.render(snapshot);
+			if (!m_framePrefix.empty())
+			{
+				ostringstream filename;
+				filename << m_framePrefix << setw(6) << setfill('0') << (nFrames - 1) / m_frameStep << ".ppm";
+				if (!renderer.writePpm(filename.str()))
+					isRendering = false;
+			}
+			if (!m_videoFile.empty() && !video.addFrame(renderer.getPixels()))
+				isRendering = false;
+		}
+		if (status == GWSTATUS_PLAYER_DIED && !gw->isGameOver())
+			needsNewLevel = true;
+		else if (status == GWSTATUS_FINISHED_LEVEL)
+		{
+			gw->advanceToNextLevel();
+			needsNewLevel = true;
+		}
+		if (needsNewLevel)
+			status = GWSTATUS_CONTINUE_GAME;
+	}
+
+	  // a game that ended early must still have used up every recorded tick
+	if (!completed && !replay.playTick())
+		completed = true;
+
+	result.score = gw->getScore();
+	result.stateHash = gw->getStateHash();
+	result.matchesRecording = completed && replay.hasResult() &&
+		result.score == replay.getRecordedScore() && result.stateHash == replay.getRecordedHash();
+
+	m_replayMode = replay_off;
+	m_replay = nullptr;
+	return completed;
+}
+
+void GameController::quitGame()
+{
+	  // The simulation thread only asks for it, the game ends once the thread stopped.
+	  // A replay that quits just ends there, the replays around it go on.
+	if (this_thread::get_id() == m_simulationThreadId || m_replayMode == replay_play)
+	{
+		m_quitRequested = true;
+		return;
+	}
+
+	if (m_replayMode == replay_record && !m_replayFile.empty())
+	{
+		if (!m_replay->save(m_replayFile))
+			cout << "Cannot write replay file " << m_replayFile << endl;
+	}
+	exit(0);
+}
+
 void GameController::keyboardEvent(unsigned char key, int /* x */, int /* y */)
 {
 	switch (key)
@@ -169,7 +428,7 @@ void GameController::keyboardEvent(unsigned char key, int /* x */, int /* y */)
 		case 's': case '2': m_lastKeyHit = KEY_PRESS_DOWN;  break;
 		case 'f':           m_singleStep = true;			break;
 		case 'r':           m_singleStep = false;			break;
-		case 'q': case 'Q': m_gameState = quit;				break;
+		case 'q': case 'Q': m_quitRequested = true;			break;
 		default:            m_lastKeyHit = key;				break;
 	}
 }
@@ -188,7 +447,7 @@ void GameController::specialKeyboardEvent(int key, int /* x */, int /* y */)
 
 void GameController::playSound(int soundID)
 {
-	if (soundID == SOUND_NONE)
+	if (soundID == SOUND_NONE || m_headless || m_replayMode == replay_play)
 		return;
 
 	SoundMapType::const_iterator p = m_soundMap.find(soundID);
@@ -230,7 +489,11 @@ void GameController::doSomething()
 			m_curIntraFrameTick = ANIMATION_POSITIONS_PER_TICK;
 			m_nextStateAfterAnimate = not_applicable;
 			{
+				if (m_replayMode == replay_record)
+					m_replay->recordTick();
 				int status = m_gw->move();
+				if (m_replayMode == replay_record)
+					m_replay->setResult(m_gw->getScore(), m_gw->getStateHash());
 				if (status == GWSTATUS_PLAYER_DIED)
 				{
 					  // animate one last frame so the player can see what happened
@@ -246,7 +509,7 @@ void GameController::doSomething()
 			m_gameState = animate;
 			break;
 		case animate:
-			displayGamePlay();
+			snapshotGamePlay();
 			if (m_curIntraFrameTick-- <= 0)
 			{
 				if (m_nextStateAfterAnimate != not_applicable)
@@ -275,7 +538,7 @@ void GameController::doSomething()
 			m_nextStateAfterPrompt = quit;
 			break;
 		case prompt:
-			drawPrompt(m_mainMessage, m_secondMessage);
+			snapshotPrompt();
 			{
 				int key;
 				if (getLastKey(key) && key == '\r')
@@ -303,59 +566,216 @@ void GameController::doSomething()
 			}
 			break;
 		case quit:
-			exit(0);
+			m_quitRequested = true;
+			break;
+	}
+}
+
+void GameController::snapshotGamePlay()
+{
+	fillGamePlaySnapshot(m_snapshots.getWriteBuffer());
+	m_snapshots.publish();
+}
+
+void GameController::fillGamePlaySnapshot(RenderSnapshot& snapshot)
+{
+	m_frameNumber++;
+
+	  // The camera shows at most VIEW_WIDTH x VIEW_HEIGHT fields and keeps its target
+	  // in the middle, but never scrolls past the edges of the board. Boards smaller
+	  // than that are scaled up to fill the window.
+	int boardWidth = m_gw->getBoardWidth();
+	int boardHeight = m_gw->getBoardHeight();
+	int viewWidth = min(boardWidth, VIEW_WIDTH);
+	int viewHeight = min(boardHeight, VIEW_HEIGHT);
+	double cameraX = 0;
+	double cameraY = 0;
+	GraphObject* target = m_gw->getCameraTarget();
+	if (target != nullptr)
+	{
+		double targetX, targetY;
+		target->getAnimationLocation(targetX, targetY);
+		cameraX = max(0.0, min(targetX - (viewWidth - 1) / 2.0, double(boardWidth - viewWidth)));
+		cameraY = max(0.0, min(targetY - (viewHeight - 1) / 2.0, double(boardHeight - viewHeight)));
+	}
+	snapshot.kind = RenderSnapshot::gameplay;
+	snapshot.frameNumber = m_frameNumber;
+	snapshot.cameraX = cameraX;
+	snapshot.cameraY = cameraY;
+	snapshot.boardWidth = boardWidth;
+	snapshot.boardHeight = boardHeight;
+	snapshot.viewWidth = viewWidth;
+	snapshot.viewHeight = viewHeight;
+	snapshot.spriteScale = min(double(VIEW_WIDTH) / viewWidth, double(VIEW_HEIGHT) / viewHeight);
+
+	  // One more field around the view catches objects sliding into it. The renderers cache
+	  // the background in whole blocks, so everything in the blocks that reach into the view
+	  // goes into the snapshot, and one field more for walls that overlap a block's edge.
+	int minX = int(floor(cameraX)) - 1;
+	int minY = int(floor(cameraY)) - 1;
+	snapshot.backgroundX0 = toBackgroundBlock(max(minX, 0));
+	snapshot.backgroundY0 = toBackgroundBlock(max(minY, 0));
+	snapshot.backgroundX1 = toBackgroundBlock(min(minX + viewWidth + 2, boardWidth - 1));
+	snapshot.backgroundY1 = toBackgroundBlock(min(minY + viewHeight + 2, boardHeight - 1));
+	m_visibleObjects.clear();
+	m_gw->getGraphObjectsIn(snapshot.backgroundX0 * BACKGROUND_BLOCK_SIZE - 1, snapshot.backgroundY0 * BACKGROUND_BLOCK_SIZE - 1,
+							(snapshot.backgroundX1 + 1) * BACKGROUND_BLOCK_SIZE, (snapshot.backgroundY1 + 1) * BACKGROUND_BLOCK_SIZE,
+							m_visibleObjects);
+
+	snapshot.sprites.resize(m_visibleObjects.size());
+	for (size_t k = 0; k < m_visibleObjects.size(); k++)
+	{
+		GraphObject* cur = m_visibleObjects[k];
+		RenderSprite& sprite = snapshot.sprites[k];
+		sprite.visible = cur->isVisible();
+		if (sprite.visible)
+			cur->animate(m_frameNumber);
+
+		sprite.id = reinterpret_cast<size_t>(cur);
+		sprite.imageID = cur->getID();
+		cur->getAnimationLocation(sprite.x, sprite.y);
+		sprite.direction = cur->getDirection();
+		sprite.frame = cur->getAnimationNumber();
+		sprite.background = GameWorld::isBackgroundImage(sprite.imageID);
 	}
+	snapshot.backgroundVersion = m_gw->getBackgroundVersion();
+	  // the one copy of the status line, the snapshot goes over to the GLUT thread
+	snapshot.statText = m_gw->getGameStatText();
 }
 
-void GameController::displayGamePlay()
+void GameController::snapshotPrompt()
+{
+	RenderSnapshot& snapshot = m_snapshots.getWriteBuffer();
+	snapshot.kind = RenderSnapshot::prompt;
+	snapshot.mainMessage = m_mainMessage;
+	snapshot.secondMessage = m_secondMessage;
+	m_snapshots.publish();
+}
+
+void GameController::render()
+{
+	  // The simulation thread stopped because the game ends, end it here where GLUT runs
+	if (m_simulationDone)
+	{
+		m_simulation.join();
+		quitGame();
+	}
+
+	  // Without a new snapshot the last one is simply drawn again
+	m_snapshots.update();
+	const RenderSnapshot& snapshot = m_snapshots.getReadBuffer();
+	if (snapshot.kind == RenderSnapshot::gameplay)
+		drawGamePlay(snapshot);
+	else if (snapshot.kind == RenderSnapshot::prompt)
+		drawPrompt(snapshot.mainMessage, snapshot.secondMessage);
+}
+
+void GameController::drawGamePlay(const RenderSnapshot& snapshot)
 {
 	glEnable(GL_DEPTH_TEST); // must be done each time before displaying graphics or gets disabled for some reason
 	glLoadIdentity();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	gluLookAt(0, 0, 0, 0, 0, -1, 0, 1, 0);
-	
-	std::set<GraphObject*>& graphObjects = GraphObject::getGraphObjects();
-	for (auto it = graphObjects.begin(); it != graphObjects.end(); it++)
+
+	  // Every block of the background has a display list in board coordinates, compiled
+	  // when the block comes into view and kept until the background changes. Scrolling
+	  // only moves them by the camera.
+	if (!m_backgroundKey.matches(snapshot))
+	{
+		for (size_t k = 0; k < m_backgroundBlocks.size(); k++)
+			glDeleteLists(m_backgroundBlocks[k].list, 1);
+		m_backgroundBlocks.clear();
+		m_backgroundKey.set(snapshot);
+	}
+	  // blocks just out of view are kept, so walking back and forth does not compile them again
+	for (size_t k = 0; k < m_backgroundBlocks.size(); )
 	{
-		GraphObject* cur = *it;
-		if (cur->isVisible())
+		const BackgroundBlock& block = m_backgroundBlocks[k];
+		if (block.x < snapshot.backgroundX0 - 1 || block.x > snapshot.backgroundX1 + 1 ||
+			block.y < snapshot.backgroundY0 - 1 || block.y > snapshot.backgroundY1 + 1)
 		{
-			cur->animate();
-
-			double x, y, gx, gy, gz;
-			cur->getAnimationLocation(x,y);
-			convertToGlutCoords(x,y, gx, gy, gz);
-			
-			SpriteManager::Angles angle;
-			switch (cur->getDirection())
-			{
-				case GraphObject::up:
-					angle = SpriteManager::face_up;
-					break;
-				case GraphObject::down:
-					angle = SpriteManager::face_down;
-					break;
-				case GraphObject::left:
-					angle = SpriteManager::face_left;
-					break;
-				default:
-				case GraphObject::right:
-				case GraphObject::none:
-					angle = SpriteManager::face_right;
-					break;
-			}
-
-			int imageID = cur->getID();
-			int frame = cur->getAnimationNumber() % m_spriteManager.getNumFrames(imageID);
-			m_spriteManager.plotSprite(imageID, frame, gx, gy, gz, angle);
+			glDeleteLists(block.list, 1);
+			m_backgroundBlocks[k] = m_backgroundBlocks.back();
+			m_backgroundBlocks.pop_back();
 		}
+		else
+			k++;
 	}
+
+	  // the blocks are in board coordinates, the camera moves all of them at once
+	double cameraGx, cameraGy, originGx, originGy, gz;
+	convertToGlutCoords(snapshot.cameraX, snapshot.cameraY, snapshot.viewWidth, snapshot.viewHeight, cameraGx, cameraGy, gz);
+	convertToGlutCoords(0, 0, snapshot.viewWidth, snapshot.viewHeight, originGx, originGy, gz);
+	glPushMatrix();
+	glTranslated(originGx - cameraGx, originGy - cameraGy, 0);
+	for (int by = snapshot.backgroundY0; by <= snapshot.backgroundY1; by++)
+		for (int bx = snapshot.backgroundX0; bx <= snapshot.backgroundX1; bx++)
+			glCallList(getBackgroundBlockList(snapshot, bx, by));
+	glPopMatrix();
+
+	for (size_t k = 0; k < snapshot.sprites.size(); k++)
+		if (!snapshot.sprites[k].background)
+			plotSprite(snapshot, snapshot.sprites[k], snapshot.cameraX, snapshot.cameraY);
+	m_spriteManager.drawSprites();
 	
-	drawScoreAndLives(m_gameStatText);
+	drawScoreAndLives(snapshot.statText);
 	
 	glutSwapBuffers();
 }
 
+GLuint GameController::getBackgroundBlockList(const RenderSnapshot& snapshot, int blockX, int blockY)
+{
+	for (size_t k = 0; k < m_backgroundBlocks.size(); k++)
+		if (m_backgroundBlocks[k].x == blockX && m_backgroundBlocks[k].y == blockY)
+			return m_backgroundBlocks[k].list;
+
+	  // the walls, holes and exits on the block's own fields, as if the camera were at 0, 0
+	BackgroundBlock block = { blockX, blockY, glGenLists(1) };
+	for (size_t k = 0; k < snapshot.sprites.size(); k++)
+	{
+		const RenderSprite& sprite = snapshot.sprites[k];
+		if (sprite.background && toBackgroundBlock(int(floor(sprite.x + 0.5))) == blockX &&
+			toBackgroundBlock(int(floor(sprite.y + 0.5))) == blockY)
+			plotSprite(snapshot, sprite, 0, 0);
+	}
+	glNewList(block.list, GL_COMPILE);
+	m_spriteManager.drawSprites();
+	glEndList();
+	m_backgroundBlocks.push_back(block);
+	return block.list;
+}
+
+void GameController::plotSprite(const RenderSnapshot& snapshot, const RenderSprite& cur, double cameraX, double cameraY)
+{
+	if (cur.visible)
+	{
+		double gx, gy, gz;
+		convertToGlutCoords(cur.x - cameraX, cur.y - cameraY, snapshot.viewWidth, snapshot.viewHeight, gx, gy, gz);
+
+		SpriteManager::Angles angle;
+		switch (cur.direction)
+		{
+			case GraphObject::up:
+				angle = SpriteManager::face_up;
+				break;
+			case GraphObject::down:
+				angle = SpriteManager::face_down;
+				break;
+			case GraphObject::left:
+				angle = SpriteManager::face_left;
+				break;
+			default:
+			case GraphObject::right:
+			case GraphObject::none:
+				angle = SpriteManager::face_right;
+				break;
+		}
+
+		int frame = cur.frame % m_spriteManager.getNumFrames(cur.imageID);
+		m_spriteManager.plotSprite(cur.imageID, frame, gx, gy, gz, angle, snapshot.spriteScale);
+	}
+}
+
 void GameController::reshape (int w, int h) 
 {
 	glViewport (0, 0, (GLsizei) w, (GLsizei) h); 
@@ -365,20 +785,61 @@ void GameController::reshape (int w, int h)
 	glMatrixMode (GL_MODELVIEW); 
 } 
 
-static void convertToGlutCoords(double x, double y, double& gx, double& gy, double& gz)
+static void convertToGlutCoords(double x, double y, int viewWidth, int viewHeight, double& gx, double& gy, double& gz)
 {
-	x /= VIEW_WIDTH;
-	y /= VIEW_HEIGHT;
+	x /= viewWidth;
+	y /= viewHeight;
 	gx = 2 * VISIBLE_MIN_X + .3 + x * 2 * (VISIBLE_MAX_X - VISIBLE_MIN_X);
 	gy = 2 * VISIBLE_MIN_Y +      y * 2 * (VISIBLE_MAX_Y - VISIBLE_MIN_Y);
 	gz = .6 * VISIBLE_MIN_Z;
 }
 
-static void doOutputStroke(GLfloat x, GLfloat y, GLfloat z, GLfloat size, const char* str, bool centered)
+  // Every character of the stroke font is compiled into a display list of its own the
+  // first time text is drawn, each one moving on by the character's width like
+  // glutStrokeCharacter does, so a whole line is a single glCallLists
+static const int STROKE_FONT_CHARS = 128;
+static GLuint strokeFontBase = 0;
+static GLfloat strokeFontWidths[STROKE_FONT_CHARS];
+static StrokeLine statLine = { "", 0 };
+static StrokeLine promptLines[2] = { { "", 0 }, { "", 0 } };
+
+static void buildStrokeFont()
+{
+	if (strokeFontBase != 0)
+		return;
+	strokeFontBase = glGenLists(STROKE_FONT_CHARS);
+	for (int ch = 0; ch < STROKE_FONT_CHARS; ch++)
+	{
+		glNewList(strokeFontBase + ch, GL_COMPILE);
+		glutStrokeCharacter(GLUT_STROKE_ROMAN, ch);
+		glEndList();
+		strokeFontWidths[ch] = static_cast<GLfloat>(glutStrokeWidth(GLUT_STROKE_ROMAN, ch));
+	}
+}
+
+  // Measures the text again only when it differs from what the line holds
+static const StrokeLine& layOutStroke(StrokeLine& line, const string& text)
+{
+	if (text == line.text)
+		return line;
+
+	GLfloat width = 0;
+	for (size_t k = 0; k < text.size(); k++)
+	{
+		unsigned char ch = static_cast<unsigned char>(text[k]);
+		if (ch < STROKE_FONT_CHARS)
+			width += strokeFontWidths[ch];
+	}
+	line.text = text;
+	line.width = width;
+	return line;
+}
+
+static void doOutputStroke(GLfloat x, GLfloat y, GLfloat z, GLfloat size, const StrokeLine& line, bool centered)
 {
 	if (centered)
 	{
-		double len = glutStrokeLength(GLUT_STROKE_ROMAN, reinterpret_cast<const unsigned char*>(str)) / FONT_SCALEDOWN;
+		double len = line.width / FONT_SCALEDOWN;
 		x = -len / 2;
 		size = 1;
 	}
@@ -388,32 +849,33 @@ static void doOutputStroke(GLfloat x, GLfloat y, GLfloat z, GLfloat size, const
 	glLoadIdentity();
 	glTranslatef(x, y, z);
 	glScalef(scaledSize, scaledSize, scaledSize);
-	for ( ; *str != '\0'; str++)
-		glutStrokeCharacter(GLUT_STROKE_ROMAN, *str);
+	glListBase(strokeFontBase);
+	glCallLists(static_cast<GLsizei>(line.text.size()), GL_UNSIGNED_BYTE, line.text.c_str());
 	glPopMatrix();
 }
 
-static void outputStroke(GLfloat x, GLfloat y, GLfloat z, GLfloat size, const char* str)
+static void outputStroke(GLfloat x, GLfloat y, GLfloat z, GLfloat size, const StrokeLine& line)
 {
-	doOutputStroke(x, y, z, size, str, false);
+	doOutputStroke(x, y, z, size, line, false);
 }
 
-static void outputStrokeCentered(GLfloat y, GLfloat z, const char* str)
+static void outputStrokeCentered(GLfloat y, GLfloat z, const StrokeLine& line)
 {
-	doOutputStroke(0, y, z, 1, str, true);
+	doOutputStroke(0, y, z, 1, line, true);
 }
 
-static void drawPrompt(string mainMessage, string secondMessage)
+static void drawPrompt(const string& mainMessage, const string& secondMessage)
 {
+	buildStrokeFont();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glColor3f (1.0, 1.0, 1.0);
 	glLoadIdentity ();
-	outputStrokeCentered(1, -5, mainMessage.c_str());
-	outputStrokeCentered(-1, -5, secondMessage.c_str());
+	outputStrokeCentered(1, -5, layOutStroke(promptLines[0], mainMessage));
+	outputStrokeCentered(-1, -5, layOutStroke(promptLines[1], secondMessage));
 	glutSwapBuffers();
 }
 
-static void drawScoreAndLives(string gameStatText)
+static void drawScoreAndLives(const string& gameStatText)
 {
 	static int RATE = 1;
 	static GLfloat rgb[3] = { .6, .6, .6 };
@@ -425,6 +887,7 @@ static void drawScoreAndLives(string gameStatText)
 		else if (rgb[k] > 1.0)
 			rgb[k] = 1.0;
 	}
+	buildStrokeFont();
 	glColor3f(rgb[0], rgb[1], rgb[2]);
-	outputStrokeCentered(SCORE_Y, SCORE_Z, gameStatText.c_str());
+	outputStrokeCentered(SCORE_Y, SCORE_Z, layOutStroke(statLine, gameStatText));
 }
@@ -2,10 +2,16 @@
 #define GAMECONTROLLER_H_
 
 #include "SpriteManager.h"
+#include "Replay.h"
+#include "TripleBuffer.h"
+#include "RenderSnapshot.h"
 #include <string>
 #include <map>
+#include <vector>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <atomic>
 
 enum GameControllerState {
 	welcome, contgame, finishedlevel, init, cleanup, makemove, animate, gameover, prompt, quit, not_applicable
@@ -19,30 +25,94 @@ class GameWorld;
 class GameController
 {
   public:
+	GameController()
+	 : m_gw(nullptr), m_lastKeyHit(INVALID_KEY), m_singleStep(false), m_frameNumber(0), m_headless(false),
+	   m_replayMode(replay_off), m_replay(nullptr), m_frameStep(1), m_restoreCheckInterval(0), m_simulationThreadId(), m_quitRequested(false), m_simulationDone(false)
+	{
+	}
+
 	void run(GameWorld* gw, std::string windowTitle);
 
+	  // Record every key the world consumes into a replay file, written when the game quits
+	void recordReplay(std::string filename)
+	{
+		m_replayFile = filename;
+		m_replayMode = replay_record;
+	}
+
+	  // Run a recorded replay as fast as possible, without graphics or sound
+	bool playReplay(GameWorld* gw, Replay& replay, ReplayResult& result);
+
+	  // Let playReplay draw every frame the game would have shown with the software
+	  // renderer, into files named filePrefix followed by the frame number and ".ppm"
+	void renderFrames(std::string filePrefix)
+	{
+		m_framePrefix = filePrefix;
+	}
+
+	  // Let playReplay encode the frames it draws into a Y4M video file as well
+	void captureVideo(std::string filename)
+	{
+		m_videoFile = filename;
+	}
+
+	  // Writes the sprite atlas with its mipmaps, the sounds and the level files in
+	  // assetDir into one asset bundle. Needs no window.
+	static bool writeAssetBundle(const std::string& assetDir, const std::string& filename);
+
+	  // Only every nth frame is written to files or the video
+	void setFrameStep(unsigned int n)
+	{
+		m_frameStep = (n > 0 ? n : 1);
+	}
+
+	  // Let playReplay snapshot and restore the world every n ticks, 0 for never. The
+	  // state hash must be the same afterwards and the replay goes on from the restored world.
+	void checkRestore(unsigned int n)
+	{
+		m_restoreCheckInterval = n;
+	}
+
+	bool isHeadless() const
+	{
+		return m_headless;
+	}
+
+	  // Keys are hit on the GLUT thread and consumed on the simulation thread
 	bool getLastKey(int& value)
 	{
-		if (m_lastKeyHit != INVALID_KEY)
+		int key = m_lastKeyHit.exchange(INVALID_KEY);
+		if (key != INVALID_KEY)
 		{
-			value = m_lastKeyHit;
-			m_lastKeyHit = INVALID_KEY;
+			value = key;
 			return true;
 		}
 		return false;
 	}
 
+	  // Keys for the world come from the keyboard, or from the replay during playback
+	bool getWorldKey(int& value)
+	{
+		if (m_replayMode == replay_play)
+			return m_replay->playKey(value);
+
+		bool gotKey = getLastKey(value);
+		if (gotKey && m_replayMode == replay_record)
+			m_replay->recordKey(value);
+		return gotKey;
+	}
+
+	void quitGame();
+
 	void keyboardEvent(unsigned char key, int x, int y);
 	void specialKeyboardEvent(int key, int x, int y);
 	
 	void playSound(int soundID);
 
-	void setGameStatText(std::string text)
-	{
-		m_gameStatText = text;
-	}
-
+	  // One step of the game's state machine, run by the simulation thread
 	void doSomething();
+	  // Draws the newest snapshot the simulation published, run by the GLUT thread
+	void render();
 	void reshape(int w, int h);
 
 	  // Meyers singleton pattern
@@ -54,23 +124,56 @@ class GameController
 
 private:
 
+	enum ReplayMode { replay_off, replay_record, replay_play };
+
 	void initDrawersAndSounds();
-	void displayGamePlay();
+	void runSimulation();
+	void fillGamePlaySnapshot(RenderSnapshot& snapshot);
+	void snapshotGamePlay();
+	void snapshotPrompt();
+	void drawGamePlay(const RenderSnapshot& snapshot);
+	GLuint getBackgroundBlockList(const RenderSnapshot& snapshot, int blockX, int blockY);
+	void plotSprite(const RenderSnapshot& snapshot, const RenderSprite& sprite, double cameraX, double cameraY);
 
 	GameWorld*		m_gw;
 	GameControllerState	m_gameState;
 	GameControllerState	m_nextStateAfterPrompt;
 	GameControllerState	m_nextStateAfterAnimate;
-	int 			m_lastKeyHit;
-	bool			m_singleStep;
-	std::string		m_gameStatText;
+	std::atomic<int> m_lastKeyHit;
+	std::atomic<bool> m_singleStep;
 	std::string		m_mainMessage;
 	std::string		m_secondMessage;
 	int				m_curIntraFrameTick;
 	bool			m_playerWon;
+	unsigned int	m_frameNumber;
+	std::vector<GraphObject*> m_visibleObjects;
 	SpriteManager	m_spriteManager;
 	typedef std::map<int, std::string> SoundMapType;
 	SoundMapType	m_soundMap;
+	bool			m_headless;
+	ReplayMode		m_replayMode;
+	Replay*			m_replay;
+	Replay			m_recording;
+	std::string		m_replayFile;
+	std::string		m_framePrefix;
+	std::string		m_videoFile;
+	unsigned int	m_frameStep;
+	unsigned int	m_restoreCheckInterval;
+	std::thread		m_simulation;
+	std::thread::id	m_simulationThreadId;
+	std::atomic<bool> m_quitRequested;
+	std::atomic<bool> m_simulationDone;
+	TripleBuffer<RenderSnapshot> m_snapshots;
+	  // Display lists with the walls, holes and exits of each background block near the
+	  // view, only used by the GLUT thread
+	struct BackgroundBlock
+	{
+		int		x;
+		int		y;
+		GLuint	list;
+	};
+	std::vector<BackgroundBlock> m_backgroundBlocks;
+	BackgroundKey	m_backgroundKey;
 };
 
 inline GameController& Game()
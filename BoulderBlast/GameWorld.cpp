@@ -6,10 +6,10 @@ using namespace std;
 
 bool GameWorld::getKey(int& value)
 {
-	bool gotKey = m_controller->getLastKey(value);
+	bool gotKey = m_controller->getWorldKey(value);
 
 	if (gotKey && (value == 'q' || value == '\x03'))  // CTRL-C
-			exit(0);
+			m_controller->quitGame();
 
 	return gotKey;
 }
@@ -19,7 +19,12 @@ void GameWorld::playSound(int soundID)
 	m_controller->playSound(soundID);
 }
 
-void GameWorld::setGameStatText(string text)
+bool GameWorld::isHeadless() const
 {
-	m_controller->setGameStatText(text);
+	return m_controller->isHeadless();
+}
+
+void GameWorld::setGameStatText(const string& text)
+{
+	m_gameStatText = text;
 }
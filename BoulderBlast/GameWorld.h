@@ -3,10 +3,12 @@
 
 #include "GameConstants.h"
 #include <string>
+#include <vector>
 
 const int START_PLAYER_LIVES = 3;
 
 class GameController;
+class GraphObject;
 
 class GameWorld
 {
@@ -14,7 +16,8 @@ public:
 
 	GameWorld(std::string assetDir)
 	 : m_lives(START_PLAYER_LIVES), m_score(0), m_level(0),
-	   m_controller(nullptr), m_assetDir(assetDir)
+	   m_randomState(1), m_boardWidth(VIEW_WIDTH), m_boardHeight(VIEW_HEIGHT),
+	   m_backgroundVersion(0), m_residentChunkLimit(0), m_tickThreads(0), m_controller(nullptr), m_assetDir(assetDir)
 	{
 	}
 
@@ -26,10 +29,40 @@ public:
 	virtual int move() = 0;
 	virtual void cleanUp() = 0;
 
-	void setGameStatText(std::string text);
+	  // 64-bit hash of the complete state of the world, used to verify replays
+	virtual unsigned long long getStateHash() const = 0;
+
+	  // Appends every object on the fields from x0, y0 to x1, y1 to objects, so the
+	  // renderer only ever visits what can be on screen
+	virtual void getGraphObjectsIn(int x0, int y0, int x1, int y1, std::vector<GraphObject*>& objects) = 0;
+
+	  // The object the camera keeps in the middle of the screen, if any
+	virtual GraphObject* getCameraTarget() = 0;
+
+	void setGameStatText(const std::string& text);
+
+	  // Saves the complete state of the running level into blob and brings it back from
+	  // such a blob. A world that cannot do that saves nothing and refuses every blob.
+	virtual void snapshot(std::vector<char>& blob) const
+	{
+		blob.clear();
+	}
+
+	virtual bool restore(const std::vector<char>& /* blob */)
+	{
+		return false;
+	}
+
+	  // The status line above the game world, read whenever a snapshot is filled. A world
+	  // that keeps the line itself returns it from here and never needs to hand it over.
+	virtual const std::string& getGameStatText() const
+	{
+		return m_gameStatText;
+	}
 
 	bool getKey(int& value);
 	void playSound(int soundID);
+	bool isHeadless() const;
 
 	unsigned int getLevel() const
 	{
@@ -59,7 +92,78 @@ public:
 	{
 		m_score += howMuch;
 	}
+
+	  // Returns a pseudo-random number in [0, limit). Unlike rand(), the whole
+	  // generator state is owned by the world, so it can be saved and restored.
+	int randInt(int limit)
+	{
+		  // xorshift64*
+		m_randomState ^= m_randomState >> 12;
+		m_randomState ^= m_randomState << 25;
+		m_randomState ^= m_randomState >> 27;
+		unsigned long long r = m_randomState * 2685821657736338717ULL;
+		return static_cast<int>((r >> 32) % static_cast<unsigned int>(limit));
+	}
 	
+	  // Size of the current level in fields, which the renderer scales the board to
+	int getBoardWidth() const
+	{
+		return m_boardWidth;
+	}
+
+	int getBoardHeight() const
+	{
+		return m_boardHeight;
+	}
+
+	void setBoardSize(int width, int height)
+	{
+		m_boardWidth = width;
+		m_boardHeight = height;
+	}
+
+	  // Walls, holes and exits only change when the world says so: the renderer draws
+	  // them once into a background layer and keeps it until this version changes
+	static bool isBackgroundImage(int imageID)
+	{
+		return imageID == IID_WALL || imageID == IID_HOLE || imageID == IID_EXIT;
+	}
+
+	unsigned int getBackgroundVersion() const
+	{
+		return m_backgroundVersion;
+	}
+
+	void backgroundChanged()
+	{
+		m_backgroundVersion++;
+	}
+
+	  // How many chunks of a large board may have their actors in memory at once,
+	  // 0 leaves the choice to the world
+	unsigned int getResidentChunkLimit() const
+	{
+		return m_residentChunkLimit;
+	}
+
+	void setResidentChunkLimit(unsigned int limit)
+	{
+		m_residentChunkLimit = limit;
+	}
+
+	  // 0 keeps the classic tick in which each actor acts at once, otherwise the
+	  // actors first plan their moves, then carry them out. With 1 the calling
+	  // thread does all of it, with more the game's shared TaskScheduler helps.
+	unsigned int getTickThreads() const
+	{
+		return m_tickThreads;
+	}
+
+	void setTickThreads(unsigned int nThreads)
+	{
+		m_tickThreads = nThreads;
+	}
+
 	  // The following should be used by only the framework, not the student
 
 	bool isGameOver() const
@@ -71,6 +175,24 @@ public:
 	{
 		++m_level;
 	}
+
+	void restoreProgress(unsigned int lives, unsigned int score, unsigned int level)
+	{
+		m_lives = lives;
+		m_score = score;
+		m_level = level;
+	}
+
+	void setRandomSeed(unsigned long long seed)
+	{
+		  // the generator must never be in the all-zero state
+		m_randomState = (seed != 0 ? seed : 1);
+	}
+
+	unsigned long long getRandomState() const
+	{
+		return m_randomState;
+	}
    
 	void setController(GameController* controller)
 	{
@@ -86,8 +208,15 @@ private:
 	unsigned int	m_lives;
 	unsigned int	m_score;
 	unsigned int	m_level;
+	unsigned long long m_randomState;
+	int				m_boardWidth;
+	int				m_boardHeight;
+	unsigned int	m_backgroundVersion;
+	unsigned int	m_residentChunkLimit;
+	unsigned int	m_tickThreads;
 	GameController* m_controller;
 	std::string		m_assetDir;
+	std::string		m_gameStatText;
 };
 
 #endif // GAMEWORLD_H_
@@ -1,7 +1,6 @@
 #ifndef GRAPHOBJ_H_
 #define GRAPHOBJ_H_
 
-#include <set>
 #include <cmath>
  
 const int ANIMATION_POSITIONS_PER_TICK = 3;
@@ -22,14 +21,12 @@ class GraphObject
 	GraphObject(int imageID, int startX, int startY, Direction dir = none)
 	 : m_imageID(imageID), m_visible(false), m_x(startX), m_y(startY),
 	   m_destX(startX), m_destY(startY), m_brightness(1.0),
-	   m_animationNumber(0), m_direction(dir)
+	   m_animationNumber(0), m_lastAnimatedFrame(0), m_direction(dir)
 	{
-		getGraphObjects().insert(this);
 	}
 
 	virtual ~GraphObject()
 	{
-		getGraphObjects().erase(this);
 	}
 
 	void setVisible(bool shouldIDisplay)
@@ -98,19 +95,22 @@ class GraphObject
 		y = m_y;
 	}
 
-	void animate()
+	  // Only objects on screen are animated, so one that was not animated in the
+	  // previous frame jumps to where it is now instead of sliding there from
+	  // wherever it was last seen
+	void animate(unsigned int frame)
 	{
+		if (m_lastAnimatedFrame + 1 != frame)
+		{
+			m_x = m_destX;
+			m_y = m_destY;
+		}
+		m_lastAnimatedFrame = frame;
 		m_animationNumber++;
 		moveALittle(m_x, m_destX);
 		moveALittle(m_y, m_destY);
 	}
 
-	static std::set<GraphObject*>& getGraphObjects()
-	{
-		static std::set<GraphObject*> graphObjects;
-		return graphObjects;
-	}
-
   private:
 	int			m_imageID;
 	bool		m_visible;
@@ -120,6 +120,7 @@ class GraphObject
 	double		m_destY;
 	double		m_brightness;
 	int			m_animationNumber;
+	unsigned int m_lastAnimatedFrame;
 	Direction	m_direction;
 
 	  // Prevent copying or assigning GraphObjects
@@ -2,10 +2,13 @@
 #define LEVEL_H_
 
 #include "GameConstants.h"
-#include <iostream>
-#include <fstream>
+#include "MappedFile.h"
+#include "AssetBundle.h"
+#include <sstream>
 #include <string>
+#include <vector>
 #include <cctype>
+#include <utility>
 
 class Level
 {
@@ -19,67 +22,92 @@ public:
 	enum LoadResult {
 		load_success, load_fail_file_not_found, load_fail_bad_format};
 
+	  // Levels without a size header are VIEW_WIDTH x VIEW_HEIGHT fields,
+	  // others may be up to MAX_SIZE fields in each direction
+	static const int MAX_SIZE = 4096;
+
 	Level(std::string assetDir)
-	 : m_pathPrefix(assetDir)
+	 : m_width(VIEW_WIDTH), m_height(VIEW_HEIGHT), m_rowStart(), m_pathPrefix(assetDir)
 	{
-		for (int y = 0; y < VIEW_HEIGHT; y++)
-			for (int x = 0; x < VIEW_WIDTH; x++)
-				m_maze[y][x] = empty;
-
 		if (!m_pathPrefix.empty())
 			m_pathPrefix += '/';
 	}
 
+	  // Exchanges the loaded levels of both, without reading either file again
+	void swap(Level& other)
+	{
+		std::swap(m_width, other.m_width);
+		std::swap(m_height, other.m_height);
+		m_file.swap(other.m_file);
+		m_rowStart.swap(other.m_rowStart);
+		m_pathPrefix.swap(other.m_pathPrefix);
+	}
+
+	  // The level file stays mapped into memory while the level is in use, and
+	  // fields are decoded straight from it, so even huge levels are never copied.
+	  // Levels in the shared asset bundle are read from its mapping instead.
 	LoadResult loadLevel(std::string filename)
 	{
-		std::ifstream levelFile((m_pathPrefix + filename).c_str());
-		if (!levelFile)
+		m_rowStart.clear();
+		const char* bundled;
+		size_t bundledSize;
+		if (AssetBundle::getShared().find(filename, bundled, bundledSize))
+			m_file.openView(bundled, bundledSize);
+		else if (!m_file.open(m_pathPrefix + filename))
 			return load_fail_file_not_found;
 
-		  // get the maze
+		  // an optional first line "size <width> <height>" gives the dimensions of the maze
+
+		size_t pos = 0, begin, end;
+		bool haveLine = nextLine(pos, begin, end);
+		m_width = VIEW_WIDTH;
+		m_height = VIEW_HEIGHT;
+		if (haveLine && std::string(m_file.getData() + begin, end - begin).compare(0, 4, "size") == 0)
+		{
+			std::istringstream header(std::string(m_file.getData() + begin + 4, end - begin - 4));
+			std::string rest;
+			if (!(header >> m_width >> m_height) || (header >> rest) ||
+				m_width < 1 || m_width > MAX_SIZE || m_height < 1 || m_height > MAX_SIZE)
+				return load_fail_bad_format;
+			haveLine = nextLine(pos, begin, end);
+		}
+		m_rowStart.resize(m_height);
+		for (int y = 0; y < m_height; y++)
+			m_rowStart[y] = NO_ROW;
+
+		  // check the maze
 
-		std::string line;
 		bool foundExit = false;
 		bool foundPlayer = false;
 
-		for (int y = VIEW_HEIGHT-1; std::getline(levelFile, line); y--)
+		for (int y = m_height-1; haveLine; y--, haveLine = nextLine(pos, begin, end))
 		{
 			if (y < 0)	// too many maze lines?
 			{
-				if (line.find_first_not_of(" \t\r") != std::string::npos)
-					return load_fail_bad_format;  // non-blank line
-				char dummy;
-				if (levelFile >> dummy)	 // non-blank rest of file
-				return load_fail_bad_format;
+				for (size_t k = begin; k < m_file.getSize(); k++)
+					if (!isspace(static_cast<unsigned char>(m_file.getData()[k])))
+						return load_fail_bad_format;  // non-blank rest of file
 				break;
 			}
 
-			if (line.size() < VIEW_WIDTH  ||  line.find_first_not_of(" \t\r", VIEW_WIDTH) != std::string::npos)
+			if (end - begin < static_cast<size_t>(m_width))
 				return load_fail_bad_format;
-				
-			for (int x = 0; x < VIEW_WIDTH; x++)
+			for (size_t k = begin + m_width; k < end; k++)
+				if (!isBlank(m_file.getData()[k]))
+					return load_fail_bad_format;
+
+			for (int x = 0; x < m_width; x++)
 			{
-				MazeEntry me;
-				switch (tolower(line[x]))
-				{
-					default:   return load_fail_bad_format;
-					case ' ':  me = empty;						break;
-					case 'x':  me = exit; foundExit = true;		break;
-					case '@':  me = player; foundPlayer = true; break;
-					case 'h':  me = horiz_snarlbot;				break;
-					case 'v':  me = vert_snarlbot;				break;
-					case '1':  me = kleptobot_factory;			break;
-					case '2':  me = angry_kleptobot_factory;	break;
-					case '#':  me = wall;						break;
-					case 'b':  me = boulder;					break;
-					case 'o':  me = hole;						break;
-					case '*':  me = jewel;						break;
-					case 'r':  me = restore_health;				break;
-					case 'e':  me = extra_life;					break;
-					case 'a':  me = ammo;						break;
-				}
-				m_maze[y][x] = me;
+				char c = m_file.getData()[begin + x];
+				if (!isValidEntry(c))
+					return load_fail_bad_format;
+				MazeEntry me = decode(c);
+				if (me == exit)
+					foundExit = true;
+				else if (me == player)
+					foundPlayer = true;
 			}
+			m_rowStart[y] = begin;
 		}
 
 		if (!foundExit || !foundPlayer || !edgesValid())
@@ -90,21 +118,90 @@ public:
 
 	MazeEntry getContentsOf(unsigned int x, unsigned int y) const
 	{
-		return (x < VIEW_WIDTH && y < VIEW_HEIGHT) ? m_maze[y][x] : empty;
+		if (x >= static_cast<unsigned int>(m_width) || y >= m_rowStart.size() || m_rowStart[y] == NO_ROW)
+			return empty;
+		return decode(m_file.getData()[m_rowStart[y] + x]);
+	}
+
+	int getWidth() const
+	{
+		return m_width;
+	}
+
+	int getHeight() const
+	{
+		return m_height;
 	}
 
 private:
 
-	MazeEntry	m_maze[VIEW_HEIGHT][VIEW_WIDTH];
-	std::string m_pathPrefix;
+	static const size_t NO_ROW = static_cast<size_t>(-1);
+
+	int					m_width;
+	int					m_height;
+	MappedFile			m_file;
+	std::vector<size_t>	m_rowStart;		// offset of each row of the maze in the file, bottom row first
+	std::string			m_pathPrefix;
+
+	  // Same lines as std::getline would return: a final newline does not start another one
+	bool nextLine(size_t& pos, size_t& begin, size_t& end) const
+	{
+		if (pos >= m_file.getSize())
+			return false;
+		begin = pos;
+		end = pos;
+		while (end < m_file.getSize() && m_file.getData()[end] != '\n')
+			end++;
+		pos = end + 1;
+		return true;
+	}
+
+	static bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static bool isValidEntry(char c)
+	{
+		switch (tolower(c))
+		{
+			case ' ': case 'x': case '@': case 'h': case 'v': case '1': case '2':
+			case '#': case 'b': case 'o': case '*': case 'r': case 'e': case 'a':
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	static MazeEntry decode(char c)
+	{
+		switch (tolower(c))
+		{
+			default:
+			case ' ':  return empty;
+			case 'x':  return exit;
+			case '@':  return player;
+			case 'h':  return horiz_snarlbot;
+			case 'v':  return vert_snarlbot;
+			case '1':  return kleptobot_factory;
+			case '2':  return angry_kleptobot_factory;
+			case '#':  return wall;
+			case 'b':  return boulder;
+			case 'o':  return hole;
+			case '*':  return jewel;
+			case 'r':  return restore_health;
+			case 'e':  return extra_life;
+			case 'a':  return ammo;
+		}
+	}
 
 	bool edgesValid() const
 	{
-		for (int y = 0; y < VIEW_HEIGHT; y++)
-			if (m_maze[y][0] != wall || m_maze[y][VIEW_WIDTH-1] != wall)
+		for (int y = 0; y < m_height; y++)
+			if (getContentsOf(0, y) != wall || getContentsOf(m_width-1, y) != wall)
 				return false;
-		for (int x = 0; x < VIEW_WIDTH; x++)
-			if (m_maze[0][x] != wall || m_maze[VIEW_HEIGHT-1][x] != wall)
+		for (int x = 0; x < m_width; x++)
+			if (getContentsOf(x, 0) != wall || getContentsOf(x, m_height-1) != wall)
 				return false;
 
 		return true;
@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+#include <utility>
+using namespace std;
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: m_data(nullptr), m_size(0), m_isMapped(false)
+#if defined(_WIN32)
+	, m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::swap(MappedFile& other)
+{
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	std::swap(m_isMapped, other.m_isMapped);
+#if defined(_WIN32)
+	std::swap(m_file, other.m_file);
+	std::swap(m_mapping, other.m_mapping);
+#endif
+}
+
+void MappedFile::openView(const char* data, size_t size)
+{
+	close();
+	m_data = data;
+	m_size = size;
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const string& filename)
+{
+	close();
+
+	m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0)
+	{
+		m_data = "";
+		return true;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr)
+		m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_isMapped = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_isMapped)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_isMapped = false;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::prefetch() const
+{
+	//PrefetchVirtualMemory needs Windows 8, before that the pages are read as they are touched
+}
+
+#else
+
+bool MappedFile::open(const string& filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+	m_size = static_cast<size_t>(info.st_size);
+	if (m_size == 0)
+	{
+		::close(fd);
+		m_data = "";
+		return true;
+	}
+
+	//The mapping stays valid after the descriptor is closed
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		m_size = 0;
+		return false;
+	}
+	m_data = static_cast<const char*>(data);
+	m_isMapped = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_isMapped)
+		munmap(const_cast<char*>(m_data), m_size);
+	m_data = nullptr;
+	m_size = 0;
+	m_isMapped = false;
+}
+
+void MappedFile::prefetch() const
+{
+	if (m_isMapped)
+		madvise(const_cast<char*>(m_data), m_size, MADV_WILLNEED);
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <string>
+#include <cstddef>
+
+//Read-only view of a whole file mapped into memory. Pages are only read from disk when they are
+//first touched, so even a huge file costs nothing until its contents are actually used.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& filename);
+	void close();
+
+	//Shows size bytes of memory someone else owns, like a file inside an asset bundle, as if they
+	//were a file of their own. They must stay valid while the view is open.
+	void openView(const char* data, size_t size);
+
+	//Exchanges the files of both, neither is unmapped or read again
+	void swap(MappedFile& other);
+
+	//Asks the system to read the whole file now, in one sequential pass, instead of page by page
+	//when it is touched
+	void prefetch() const;
+
+	bool isOpen() const
+	{
+		return m_data != nullptr;
+	}
+
+	const char* getData() const
+	{
+		return m_data;
+	}
+
+	size_t getSize() const
+	{
+		return m_size;
+	}
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+private:
+	const char*	m_data;
+	size_t		m_size;
+	bool		m_isMapped;		//an empty file cannot be mapped and points at an empty string instead
+#if defined(_WIN32)
+	void*		m_file;
+	void*		m_mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_H_
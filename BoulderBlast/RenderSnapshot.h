@@ -0,0 +1,95 @@
+#ifndef RENDERSNAPSHOT_H_
+#define RENDERSNAPSHOT_H_
+
+#include <string>
+#include <vector>
+
+  // The background layer is cached in square blocks of this many fields on the board,
+  // so scrolling only ever draws the blocks that come into view
+const int BACKGROUND_BLOCK_SIZE = 8;
+
+  // Block of the background that field x or y lies in, also for fields left of or below
+  // the board
+inline int toBackgroundBlock(int field)
+{
+	return (field >= 0 ? field : field - (BACKGROUND_BLOCK_SIZE - 1)) / BACKGROUND_BLOCK_SIZE;
+}
+
+  // What the simulation hands to the renderer: everything needed to draw one frame,
+  // so the renderer never touches the world while the simulation changes it
+struct RenderSprite
+{
+	size_t			id;				// identifies the object while it exists
+	int				imageID;
+	double			x;				// animation location on the board
+	double			y;
+	int				direction;
+	unsigned int	frame;			// animation number, not yet reduced to the sprite's frames
+	bool			visible;
+	bool			background;		// part of the layer that only changes with backgroundVersion
+};
+
+struct RenderSnapshot
+{
+	enum Kind { none, gameplay, prompt };
+
+	Kind			kind;
+	unsigned int	frameNumber;
+	double			cameraX;
+	double			cameraY;
+	int				boardWidth;
+	int				boardHeight;
+	int				viewWidth;
+	int				viewHeight;
+	double			spriteScale;
+	unsigned int	backgroundVersion;
+	int				backgroundX0;	// the blocks from backgroundX0, backgroundY0 up to and including
+	int				backgroundY0;	// backgroundX1, backgroundY1 cover the view on the board, sprites
+	int				backgroundX1;	// has every object in them and in the fields right around them
+	int				backgroundY1;
+	std::vector<RenderSprite> sprites;
+	std::string		statText;
+	std::string		mainMessage;
+	std::string		secondMessage;
+
+	RenderSnapshot()
+	 : kind(none), frameNumber(0), cameraX(0), cameraY(0), boardWidth(1), boardHeight(1), viewWidth(1), viewHeight(1), spriteScale(1),
+	   backgroundVersion(0), backgroundX0(0), backgroundY0(0), backgroundX1(-1), backgroundY1(-1)
+	{
+	}
+};
+
+  // Everything the cached background blocks depend on. They are drawn in board
+  // coordinates, so the camera is not part of it: renderers keep the key of the blocks
+  // they drew and throw all of them away only when a snapshot no longer matches.
+struct BackgroundKey
+{
+	bool			isValid;
+	unsigned int	version;
+	int				viewWidth;
+	int				viewHeight;
+	double			spriteScale;
+
+	BackgroundKey()
+	 : isValid(false), version(0), viewWidth(0), viewHeight(0), spriteScale(0)
+	{
+	}
+
+	bool matches(const RenderSnapshot& snapshot) const
+	{
+		return isValid && version == snapshot.backgroundVersion &&
+			viewWidth == snapshot.viewWidth && viewHeight == snapshot.viewHeight &&
+			spriteScale == snapshot.spriteScale;
+	}
+
+	void set(const RenderSnapshot& snapshot)
+	{
+		isValid = true;
+		version = snapshot.backgroundVersion;
+		viewWidth = snapshot.viewWidth;
+		viewHeight = snapshot.viewHeight;
+		spriteScale = snapshot.spriteScale;
+	}
+};
+
+#endif // RENDERSNAPSHOT_H_
@@ -0,0 +1,212 @@
+#include "Replay.h"
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+	const char REPLAY_MAGIC[4] = { 'B', 'B', 'R', 'P' };
+	//Version 1 did not store the tick mode and chunk limit yet, its replays all used the classic
+	//tick and the world's own limit
+	const unsigned int REPLAY_VERSION = 2;
+
+	//All numbers are written as little endian variable length integers, 7 bits per byte
+	void putVarint(vector<unsigned char>& out, unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<unsigned char>(value));
+	}
+
+	bool getVarint(const vector<unsigned char>& in, size_t& pos, unsigned long long& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && pos < in.size(); shift += 7)
+		{
+			unsigned char byte = in[pos++];
+			value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+Replay::Replay()
+	: m_seed(0), m_startLevel(0), m_isTwoPhaseTick(false), m_residentChunkLimit(0), m_nTicks(0), m_hasResult(false), m_score(0), m_stateHash(0),
+	m_events(), m_lastEventTick(0), m_readPos(0), m_currentTick(0), m_nextEventTick(0),
+	m_nextEventKey(0), m_hasNextEvent(false)
+{
+}
+
+void Replay::startRecording(unsigned long long seed, unsigned int startLevel, bool isTwoPhaseTick,
+							unsigned int residentChunkLimit)
+{
+	m_seed = seed;
+	m_startLevel = startLevel;
+	m_isTwoPhaseTick = isTwoPhaseTick;
+	m_residentChunkLimit = residentChunkLimit;
+	m_nTicks = 0;
+	m_hasResult = false;
+	m_events.clear();
+	m_lastEventTick = 0;
+}
+
+void Replay::recordTick()
+{
+	m_nTicks++;
+}
+
+void Replay::recordKey(int key)
+{
+	//Keys are never negative, so they can be stored unsigned
+	putVarint(m_events, m_nTicks - m_lastEventTick);
+	putVarint(m_events, static_cast<unsigned int>(key));
+	m_lastEventTick = m_nTicks;
+}
+
+void Replay::setResult(unsigned int score, unsigned long long stateHash)
+{
+	m_hasResult = true;
+	m_score = score;
+	m_stateHash = stateHash;
+}
+
+bool Replay::save(const string& filename) const
+{
+	vector<unsigned char> header(REPLAY_MAGIC, REPLAY_MAGIC + 4);
+	putVarint(header, REPLAY_VERSION);
+	putVarint(header, m_seed);
+	putVarint(header, m_startLevel);
+	putVarint(header, m_isTwoPhaseTick ? 1 : 0);
+	putVarint(header, m_residentChunkLimit);
+	putVarint(header, m_nTicks);
+	putVarint(header, m_hasResult ? 1 : 0);
+	putVarint(header, m_score);
+	putVarint(header, m_stateHash);
+	putVarint(header, m_events.size());
+
+	ofstream file(filename.c_str(), ios::out | ios::binary);
+	if (!file)
+		return false;
+	file.write(reinterpret_cast<const char*>(&header[0]), header.size());
+	if (!m_events.empty())
+		file.write(reinterpret_cast<const char*>(&m_events[0]), m_events.size());
+	return static_cast<bool>(file);
+}
+
+bool Replay::load(const string& filename)
+{
+	ifstream file(filename.c_str(), ios::in | ios::binary);
+	if (!file)
+		return false;
+	vector<unsigned char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+	if (data.size() < 4 || !equal(REPLAY_MAGIC, REPLAY_MAGIC + 4, data.begin()))
+		return false;
+
+	size_t pos = 4;
+	unsigned long long version, startLevel, isTwoPhaseTick = 0, residentChunkLimit = 0, hasResult, score, nEventBytes;
+	if (!getVarint(data, pos, version) || version < 1 || version > REPLAY_VERSION ||
+		!getVarint(data, pos, m_seed) ||
+		!getVarint(data, pos, startLevel) ||
+		(version >= 2 && (!getVarint(data, pos, isTwoPhaseTick) || !getVarint(data, pos, residentChunkLimit))) ||
+		!getVarint(data, pos, m_nTicks) ||
+		!getVarint(data, pos, hasResult) ||
+		!getVarint(data, pos, score) ||
+		!getVarint(data, pos, m_stateHash) ||
+		!getVarint(data, pos, nEventBytes) ||
+		data.size() - pos != nEventBytes)
+		return false;
+
+	m_startLevel = static_cast<unsigned int>(startLevel);
+	m_isTwoPhaseTick = isTwoPhaseTick != 0;
+	m_residentChunkLimit = static_cast<unsigned int>(residentChunkLimit);
+	m_hasResult = hasResult != 0;
+	m_score = static_cast<unsigned int>(score);
+	m_events.assign(data.begin() + pos, data.end());
+	return true;
+}
+
+void Replay::startPlayback()
+{
+	m_readPos = 0;
+	m_currentTick = 0;
+	m_nextEventTick = 0;
+	m_hasNextEvent = readNextEvent();
+}
+
+bool Replay::playTick()
+{
+	//Returns false once every recorded tick has been played
+	if (m_currentTick >= m_nTicks)
+		return false;
+	m_currentTick++;
+	return true;
+}
+
+bool Replay::playKey(int& key)
+{
+	//Only hand out the next key if it was recorded during the current tick
+	if (!m_hasNextEvent || m_nextEventTick != m_currentTick)
+		return false;
+	key = m_nextEventKey;
+	m_hasNextEvent = readNextEvent();
+	return true;
+}
+
+bool Replay::readNextEvent()
+{
+	unsigned long long delta, key;
+	if (m_readPos >= m_events.size() ||
+		!getVarint(m_events, m_readPos, delta) ||
+		!getVarint(m_events, m_readPos, key))
+		return false;
+	m_nextEventTick += delta;
+	m_nextEventKey = static_cast<int>(key);
+	return true;
+}
+
+unsigned long long Replay::getSeed() const
+{
+	return m_seed;
+}
+
+unsigned int Replay::getStartLevel() const
+{
+	return m_startLevel;
+}
+
+bool Replay::isTwoPhaseTick() const
+{
+	return m_isTwoPhaseTick;
+}
+
+unsigned int Replay::getResidentChunkLimit() const
+{
+	return m_residentChunkLimit;
+}
+
+unsigned long long Replay::getTickCount() const
+{
+	return m_nTicks;
+}
+
+bool Replay::hasResult() const
+{
+	return m_hasResult;
+}
+
+unsigned int Replay::getRecordedScore() const
+{
+	return m_score;
+}
+
+unsigned long long Replay::getRecordedHash() const
+{
+	return m_stateHash;
+}
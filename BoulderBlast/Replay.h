@@ -0,0 +1,73 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <string>
+#include <vector>
+
+//Outcome of running a replay without graphics
+struct ReplayResult
+{
+	unsigned long long	ticks;
+	unsigned int		score;
+	unsigned long long	stateHash;
+	bool				matchesRecording;
+	bool				restoresMatched;	//every snapshot and restore on the way kept the state hash
+};
+
+//Compact recording of every key the world consumed, tick by tick, together with everything
+//that is needed to run it again bit for bit: the random seed, the level it started at, the
+//kind of tick the world used and how many chunks of a large level it kept in memory.
+//Keys are stored as (ticks since the previous key, key) pairs of variable length integers,
+//so ticks in which no key was pressed do not take up any space at all.
+class Replay
+{
+public:
+	Replay();
+
+	//Recording
+	void startRecording(unsigned long long seed, unsigned int startLevel, bool isTwoPhaseTick,
+						unsigned int residentChunkLimit);
+	void recordTick();
+	void recordKey(int key);
+	void setResult(unsigned int score, unsigned long long stateHash);
+
+	bool save(const std::string& filename) const;
+	bool load(const std::string& filename);
+
+	//Playback
+	void startPlayback();
+	bool playTick();
+	bool playKey(int& key);
+
+	unsigned long long getSeed() const;
+	unsigned int getStartLevel() const;
+	bool isTwoPhaseTick() const;
+	unsigned int getResidentChunkLimit() const;
+	unsigned long long getTickCount() const;
+	bool hasResult() const;
+	unsigned int getRecordedScore() const;
+	unsigned long long getRecordedHash() const;
+
+private:
+	bool readNextEvent();
+
+private:
+	unsigned long long			m_seed;
+	unsigned int				m_startLevel;
+	bool						m_isTwoPhaseTick;
+	unsigned int				m_residentChunkLimit;
+	unsigned long long			m_nTicks;
+	bool						m_hasResult;
+	unsigned int				m_score;
+	unsigned long long			m_stateHash;
+	std::vector<unsigned char>	m_events;
+
+	unsigned long long			m_lastEventTick;
+	size_t						m_readPos;
+	unsigned long long			m_currentTick;
+	unsigned long long			m_nextEventTick;
+	int							m_nextEventKey;
+	bool						m_hasNextEvent;
+};
+
+#endif // REPLAY_H_
@@ -0,0 +1,655 @@
+#include "SoftwareRenderer.h"
+#include "GraphObject.h"
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	//The OpenGL renderer looks down the z axis with a 45 degree field of view and draws sprites
+	//at z = -12, the HUD at z = -10 and prompts at z = -5. These are the halves of the width and
+	//height it sees at those distances.
+	const double PI = 4 * atan(1.0);
+	const double SPRITE_EXTENT = 12 * tan(PI / 8);
+	const double SCORE_EXTENT = 10 * tan(PI / 8);
+	const double PROMPT_EXTENT = 5 * tan(PI / 8);
+
+	//Where convertToGlutCoords puts the board and how large plotSprite draws a sprite, in
+	//OpenGL units
+	const double BOARD_MIN_X = 2 * -2.4375 + .3;
+	const double BOARD_WIDTH = 2 * (2.4375 - -2.4375);
+	const double BOARD_MIN_Y = 2 * -2.0;
+	const double BOARD_HEIGHT = 2 * (2.0 - -2.0);
+	const double SPRITE_GL_WIDTH = .67;
+	const double SPRITE_GL_HEIGHT = .54;
+
+	//Heights of the HUD line and the two prompt lines, in OpenGL units
+	const double SCORE_Y = 3.8;
+	const double PROMPT_Y = 1;
+
+	//5x8 pixel font for the characters ' ' to '~', one byte per column with the top row in the
+	//lowest bit. Rows 0 to 6 are above the baseline, row 7 is for descenders.
+	const int GLYPH_WIDTH = 5;
+	const int GLYPH_ADVANCE = 6;
+	const int GLYPH_ASCENT = 7;
+	const unsigned char FONT[95][GLYPH_WIDTH] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 },
+		{ 0x14, 0x7F, 0x14, 0x7F, 0x14 }, { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 },
+		{ 0x36, 0x49, 0x56, 0x20, 0x50 }, { 0x00, 0x08, 0x07, 0x03, 0x00 }, { 0x00, 0x1C, 0x22, 0x41, 0x00 },
+		{ 0x00, 0x41, 0x22, 0x1C, 0x00 }, { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A }, { 0x08, 0x08, 0x3E, 0x08, 0x08 },
+		{ 0x00, 0x80, 0x70, 0x30, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x00, 0x60, 0x60, 0x00 },
+		{ 0x20, 0x10, 0x08, 0x04, 0x02 }, { 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 },
+		{ 0x72, 0x49, 0x49, 0x49, 0x46 }, { 0x21, 0x41, 0x49, 0x4D, 0x33 }, { 0x18, 0x14, 0x12, 0x7F, 0x10 },
+		{ 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3C, 0x4A, 0x49, 0x49, 0x31 }, { 0x41, 0x21, 0x11, 0x09, 0x07 },
+		{ 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x46, 0x49, 0x49, 0x29, 0x1E }, { 0x00, 0x00, 0x14, 0x00, 0x00 },
+		{ 0x00, 0x40, 0x34, 0x00, 0x00 }, { 0x00, 0x08, 0x14, 0x22, 0x41 }, { 0x14, 0x14, 0x14, 0x14, 0x14 },
+		{ 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x59, 0x09, 0x06 }, { 0x3E, 0x41, 0x5D, 0x59, 0x4E },
+		{ 0x7C, 0x12, 0x11, 0x12, 0x7C }, { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 },
+		{ 0x7F, 0x41, 0x41, 0x41, 0x3E }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, { 0x7F, 0x09, 0x09, 0x09, 0x01 },
+		{ 0x3E, 0x41, 0x41, 0x51, 0x73 }, { 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 },
+		{ 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 }, { 0x7F, 0x40, 0x40, 0x40, 0x40 },
+		{ 0x7F, 0x02, 0x1C, 0x02, 0x7F }, { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E },
+		{ 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, { 0x7F, 0x09, 0x19, 0x29, 0x46 },
+		{ 0x26, 0x49, 0x49, 0x49, 0x32 }, { 0x03, 0x01, 0x7F, 0x01, 0x03 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F },
+		{ 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F }, { 0x63, 0x14, 0x08, 0x14, 0x63 },
+		{ 0x03, 0x04, 0x78, 0x04, 0x03 }, { 0x61, 0x59, 0x49, 0x4D, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x41 },
+		{ 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x41, 0x7F }, { 0x04, 0x02, 0x01, 0x02, 0x04 },
+		{ 0x40, 0x40, 0x40, 0x40, 0x40 }, { 0x00, 0x03, 0x07, 0x08, 0x00 }, { 0x20, 0x54, 0x54, 0x78, 0x40 },
+		{ 0x7F, 0x28, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x28 }, { 0x38, 0x44, 0x44, 0x28, 0x7F },
+		{ 0x38, 0x54, 0x54, 0x54, 0x18 }, { 0x00, 0x08, 0x7E, 0x09, 0x02 }, { 0x18, 0xA4, 0xA4, 0x9C, 0x78 },
+		{ 0x7F, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7D, 0x40, 0x00 }, { 0x20, 0x40, 0x40, 0x3D, 0x00 },
+		{ 0x7F, 0x10, 0x28, 0x44, 0x00 }, { 0x00, 0x41, 0x7F, 0x40, 0x00 }, { 0x7C, 0x04, 0x78, 0x04, 0x78 },
+		{ 0x7C, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 }, { 0xFC, 0x18, 0x24, 0x24, 0x18 },
+		{ 0x18, 0x24, 0x24, 0x18, 0xFC }, { 0x7C, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x24 },
+		{ 0x04, 0x04, 0x3F, 0x44, 0x24 }, { 0x3C, 0x40, 0x40, 0x20, 0x7C }, { 0x1C, 0x20, 0x40, 0x20, 0x1C },
+		{ 0x3C, 0x40, 0x30, 0x40, 0x3C }, { 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x4C, 0x90, 0x90, 0x90, 0x7C },
+		{ 0x44, 0x64, 0x54, 0x4C, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 }, { 0x00, 0x00, 0x77, 0x00, 0x00 },
+		{ 0x00, 0x41, 0x36, 0x08, 0x00 }, { 0x02, 0x01, 0x02, 0x04, 0x02 }
+	};
+
+	const unsigned int HUD_COLOR = 0xffcccccc;		//BGRA as one little endian word
+	const unsigned int PROMPT_COLOR = 0xffffffff;
+
+	//Width and height of the blocks of pixels a frame redraws when only a few sprites changed
+	const int DIRTY_BLOCK_SIZE = 16;
+
+	//Pixel row for height y in OpenGL units in a plane that shows extent units above and below
+	//the middle
+	int toPixelY(double y, double extent, unsigned int height)
+	{
+		return static_cast<int>(floor((1 - y / extent) / 2 * height + 0.5));
+	}
+
+	//dst = src + dst * (255 - src alpha) / 255 for n pixels, src with premultiplied alpha
+	void blendRow(unsigned char* dst, const unsigned char* src, unsigned int n)
+	{
+		unsigned int k = 0;
+#ifdef SOFTWARE_RENDERER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i all255 = _mm_set1_epi16(255);
+		const __m128i half = _mm_set1_epi16(128);
+		for ( ; k + 4 <= n; k += 4)
+		{
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k * 4));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + k * 4));
+
+			//Two pixels at a time, with 16 bits per channel
+			__m128i sLo = _mm_unpacklo_epi8(s, zero);
+			__m128i sHi = _mm_unpackhi_epi8(s, zero);
+			__m128i dLo = _mm_unpacklo_epi8(d, zero);
+			__m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+			//255 - alpha in every channel of its pixel
+			__m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			aLo = _mm_sub_epi16(all255, aLo);
+			aHi = _mm_sub_epi16(all255, aHi);
+
+			//x / 255 rounded, as (x + 128 + ((x + 128) >> 8)) >> 8
+			__m128i pLo = _mm_add_epi16(_mm_mullo_epi16(dLo, aLo), half);
+			__m128i pHi = _mm_add_epi16(_mm_mullo_epi16(dHi, aHi), half);
+			pLo = _mm_srli_epi16(_mm_add_epi16(pLo, _mm_srli_epi16(pLo, 8)), 8);
+			pHi = _mm_srli_epi16(_mm_add_epi16(pHi, _mm_srli_epi16(pHi, 8)), 8);
+
+			__m128i result = _mm_packus_epi16(_mm_add_epi16(sLo, pLo), _mm_add_epi16(sHi, pHi));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k * 4), result);
+		}
+#endif
+		for ( ; k < n; k++)
+		{
+			const unsigned char* s = src + k * 4;
+			unsigned char* d = dst + k * 4;
+			unsigned int inverseAlpha = 255 - s[3];
+			for (int c = 0; c < 4; c++)
+			{
+				unsigned int p = d[c] * inverseAlpha + 128;
+				d[c] = static_cast<unsigned char>(s[c] + ((p + (p >> 8)) >> 8));
+			}
+		}
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned int width, unsigned int height)
+	: m_width(width), m_height(height), m_pixels(width * height * 4, 0), m_background(width * height * 4, 0),
+	m_backgroundKey(), m_backgroundBlocks(), m_fieldOriginX(0), m_fieldOriginY(0), m_fieldWidth(0), m_fieldHeight(0),
+	m_cameraShiftX(0), m_cameraShiftY(0), m_backgroundRange(), m_isGamePlayShown(false), m_sprites(), m_lastSprites(), m_statLayout(),
+	m_dirtyBlocks(), m_nBlocksX((width + DIRTY_BLOCK_SIZE - 1) / DIRTY_BLOCK_SIZE),
+	m_nBlocksY((height + DIRTY_BLOCK_SIZE - 1) / DIRTY_BLOCK_SIZE), m_images(), m_tiles(), m_tileWidth(0), m_tileHeight(0)
+{
+	m_dirtyBlocks.resize(m_nBlocksX * m_nBlocksY, 0);
+}
+
+bool SoftwareRenderer::loadSprite(string filename_tga, int imageID, int frameNum)
+{
+	SpriteImage image;
+	return loadTga(filename_tga, image) && addSprite(image, imageID, frameNum);
+}
+
+bool SoftwareRenderer::addSprite(const SpriteImage& image, int imageID, int frameNum)
+{
+	if (imageID < 0 || frameNum < 0)
+		return false;
+
+	if (static_cast<size_t>(imageID) >= m_images.size())
+	{
+		m_images.resize(imageID + 1);
+		m_tiles.resize(imageID + 1);
+	}
+	vector<SpriteImage>& frames = m_images[imageID];
+	if (static_cast<size_t>(frameNum) >= frames.size())
+		frames.resize(frameNum + 1);
+	frames[frameNum].width = image.width;
+	frames[frameNum].height = image.height;
+	frames[frameNum].pixels = image.pixels;
+	m_tiles[imageID].clear();
+	return true;
+}
+
+void SoftwareRenderer::render(const RenderSnapshot& snapshot)
+{
+	if (snapshot.kind == RenderSnapshot::gameplay)
+		drawGamePlay(snapshot);
+	else if (snapshot.kind == RenderSnapshot::prompt)
+	{
+		clear();
+		m_isGamePlayShown = false;
+		drawText(layOutText(m_promptLayouts[0], snapshot.mainMessage, m_width / 2, toPixelY(PROMPT_Y, PROMPT_EXTENT, m_height), 3), PROMPT_COLOR);
+		drawText(layOutText(m_promptLayouts[1], snapshot.secondMessage, m_width / 2, toPixelY(-PROMPT_Y, PROMPT_EXTENT, m_height), 3), PROMPT_COLOR);
+	}
+}
+
+bool SoftwareRenderer::writePpm(const string& filename) const
+{
+	ofstream file(filename.c_str(), ios::out | ios::binary);
+	if (!file)
+		return false;
+
+	file << "P6\n" << m_width << ' ' << m_height << "\n255\n";
+	vector<char> row(m_width * 3);
+	for (unsigned int y = 0; y < m_height; y++)
+	{
+		const unsigned char* from = &m_pixels[y * m_width * 4];
+		for (unsigned int x = 0; x < m_width; x++)
+		{
+			row[x * 3] = static_cast<char>(from[x * 4 + 2]);
+			row[x * 3 + 1] = static_cast<char>(from[x * 4 + 1]);
+			row[x * 3 + 2] = static_cast<char>(from[x * 4]);
+		}
+		file.write(&row[0], row.size());
+	}
+	return static_cast<bool>(file);
+}
+
+const SpriteImage* SoftwareRenderer::getImage(int imageID, int frame) const
+{
+	if (imageID < 0 || static_cast<size_t>(imageID) >= m_images.size() || m_images[imageID].empty())
+		return nullptr;
+	const vector<SpriteImage>& frames = m_images[imageID];
+	const SpriteImage& image = frames[frame % frames.size()];
+	return image.width > 0 ? &image : nullptr;
+}
+
+const SoftwareRenderer::Tile& SoftwareRenderer::getTile(int imageID, int frame, Rotation rotation)
+{
+	vector<Tile>& tiles = m_tiles[imageID];
+	if (tiles.empty())
+		tiles.resize(m_images[imageID].size() * nRotations);
+	Tile& tile = tiles[(frame % m_images[imageID].size()) * nRotations + rotation];
+	if (!tile.pixels.empty())
+		return tile;
+
+	//Scale the frame down to the tile first, then rotate it by copying. Turned up or down, the
+	//frame's rows become the tile's columns.
+	const SpriteImage& image = *getImage(imageID, frame);
+	bool isTurned = rotation == face_up || rotation == face_down;
+	unsigned int scaledWidth = isTurned ? m_tileHeight : m_tileWidth;
+	unsigned int scaledHeight = isTurned ? m_tileWidth : m_tileHeight;
+	vector<unsigned char> scaled(scaledWidth * scaledHeight * 4);
+	for (unsigned int v = 0; v < scaledHeight; v++)
+	{
+		unsigned int fromY0 = v * image.height / scaledHeight;
+		unsigned int fromY1 = max(fromY0 + 1, (v + 1) * image.height / scaledHeight);
+		for (unsigned int u = 0; u < scaledWidth; u++)
+		{
+			unsigned int fromX0 = u * image.width / scaledWidth;
+			unsigned int fromX1 = max(fromX0 + 1, (u + 1) * image.width / scaledWidth);
+
+			//Average with premultiplied alpha, so transparent pixels do not darken the edges
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (unsigned int fy = fromY0; fy < fromY1; fy++)
+			{
+				for (unsigned int fx = fromX0; fx < fromX1; fx++)
+				{
+					const unsigned char* p = &image.pixels[(fy * image.width + fx) * 4];
+					for (int c = 0; c < 3; c++)
+						sum[c] += (p[c] * p[3] + 127) / 255;
+					sum[3] += p[3];
+				}
+			}
+			unsigned int n = (fromY1 - fromY0) * (fromX1 - fromX0);
+			for (int c = 0; c < 4; c++)
+				scaled[(v * scaledWidth + u) * 4 + c] = static_cast<unsigned char>((sum[c] + n / 2) / n);
+		}
+	}
+
+	//Tile rows go from the top to the bottom, the frame's rows from the bottom to the top
+	tile.width = m_tileWidth;
+	tile.height = m_tileHeight;
+	tile.pixels.resize(m_tileWidth * m_tileHeight * 4);
+	for (unsigned int j = 0; j < m_tileHeight; j++)
+	{
+		for (unsigned int i = 0; i < m_tileWidth; i++)
+		{
+			unsigned int u, v;
+			switch (rotation)
+			{
+			default:
+			case face_right:	u = i;						v = m_tileHeight - 1 - j;	break;
+			case face_left:		u = m_tileWidth - 1 - i;	v = m_tileHeight - 1 - j;	break;
+			case face_up:		u = m_tileHeight - 1 - j;	v = m_tileWidth - 1 - i;	break;
+			case face_down:		u = j;						v = i;						break;
+			}
+			const unsigned char* from = &scaled[(v * scaledWidth + u) * 4];
+			copy(from, from + 4, &tile.pixels[(j * m_tileWidth + i) * 4]);
+		}
+	}
+	return tile;
+}
+
+void SoftwareRenderer::drawGamePlay(const RenderSnapshot& snapshot)
+{
+	//Sprites of a new size need new tiles
+	double pixelsPerUnitX = m_width / (2 * SPRITE_EXTENT);
+	double pixelsPerUnitY = m_height / (2 * SPRITE_EXTENT);
+	unsigned int tileWidth = max(1, static_cast<int>(floor(snapshot.spriteScale * SPRITE_GL_WIDTH * pixelsPerUnitX + 0.5)));
+	unsigned int tileHeight = max(1, static_cast<int>(floor(snapshot.spriteScale * SPRITE_GL_HEIGHT * pixelsPerUnitY + 0.5)));
+	if (tileWidth != m_tileWidth || tileHeight != m_tileHeight)
+	{
+		m_tileWidth = tileWidth;
+		m_tileHeight = tileHeight;
+		for (size_t k = 0; k < m_tiles.size(); k++)
+			m_tiles[k].clear();
+		m_backgroundKey = BackgroundKey();
+	}
+
+	//The same way convertToGlutCoords places the fields, with the camera at 0, 0
+	m_fieldOriginX = (BOARD_MIN_X / SPRITE_EXTENT + 1) / 2 * m_width;
+	m_fieldOriginY = (1 - BOARD_MIN_Y / SPRITE_EXTENT) / 2 * m_height;
+	m_fieldWidth = BOARD_WIDTH / snapshot.viewWidth * pixelsPerUnitX;
+	m_fieldHeight = BOARD_HEIGHT / snapshot.viewHeight * pixelsPerUnitY;
+
+	//A changed background or a scroll means drawing everything
+	const Rect all = { 0, 0, static_cast<int>(m_width), static_cast<int>(m_height) };
+	bool isFullRedraw = updateBackground(snapshot) || !m_isGamePlayShown;
+
+	m_sprites.clear();
+	placeSprites(snapshot, false, m_cameraShiftX, m_cameraShiftY, m_sprites);
+	if (isFullRedraw)
+	{
+		m_pixels = m_background;
+		for (size_t k = 0; k < m_sprites.size(); k++)
+			drawTile(*m_sprites[k].tile, m_sprites[k].rect.x0, m_sprites[k].rect.y0, all, m_pixels, all);
+	}
+	else
+	{
+		markChangedSprites();
+		if (snapshot.statText != m_statLayout.text)
+			markDirty(m_statLayout.bounds);
+		redrawDirtyBlocks();
+	}
+
+	//The HUD goes over everything in every frame, so blocks redrawn below it get it back
+	drawText(layOutText(m_statLayout, snapshot.statText, m_width / 2, toPixelY(SCORE_Y, SCORE_EXTENT, m_height), 2), HUD_COLOR);
+	m_lastSprites.swap(m_sprites);
+	m_isGamePlayShown = true;
+}
+
+bool SoftwareRenderer::updateBackground(const RenderSnapshot& snapshot)
+{
+	//A new level, a filled hole or a revealed exit throws every block away
+	bool isChanged = false;
+	if (!m_backgroundKey.matches(snapshot))
+	{
+		m_backgroundBlocks.clear();
+		m_backgroundKey.set(snapshot);
+		isChanged = true;
+	}
+
+	//Blocks just out of view are kept, so walking back and forth does not draw them again
+	for (size_t k = 0; k < m_backgroundBlocks.size(); )
+	{
+		const BackgroundBlock& block = m_backgroundBlocks[k];
+		if (block.x < snapshot.backgroundX0 - 1 || block.x > snapshot.backgroundX1 + 1 ||
+			block.y < snapshot.backgroundY0 - 1 || block.y > snapshot.backgroundY1 + 1)
+		{
+			swap(m_backgroundBlocks[k], m_backgroundBlocks.back());
+			m_backgroundBlocks.pop_back();
+		}
+		else
+			k++;
+	}
+
+	//The camera moves by whole pixels, rounded the same way for every frame
+	int shiftX = static_cast<int>(floor(snapshot.cameraX * m_fieldWidth + 0.5));
+	int shiftY = -static_cast<int>(floor(snapshot.cameraY * m_fieldHeight + 0.5));
+	const Rect range = { snapshot.backgroundX0, snapshot.backgroundY0, snapshot.backgroundX1, snapshot.backgroundY1 };
+	if (shiftX != m_cameraShiftX || shiftY != m_cameraShiftY || range.x0 != m_backgroundRange.x0 ||
+		range.y0 != m_backgroundRange.y0 || range.x1 != m_backgroundRange.x1 || range.y1 != m_backgroundRange.y1)
+	{
+		m_cameraShiftX = shiftX;
+		m_cameraShiftY = shiftY;
+		m_backgroundRange = range;
+		isChanged = true;
+	}
+	if (!isChanged)
+	{
+		for (int by = range.y0; by <= range.y1 && !isChanged; by++)
+			for (int bx = range.x0; bx <= range.x1 && !isChanged; bx++)
+				getBackgroundBlock(snapshot, bx, by, isChanged);
+		if (!isChanged)
+			return false;
+	}
+
+	//Copy the part of every block in view to where the camera puts it
+	fill(m_background.begin(), m_background.end(), 0);
+	for (int by = range.y0; by <= range.y1; by++)
+	{
+		for (int bx = range.x0; bx <= range.x1; bx++)
+		{
+			bool isNew = false;
+			const BackgroundBlock& block = getBackgroundBlock(snapshot, bx, by, isNew);
+			int blockWidth = block.rect.x1 - block.rect.x0;
+			int x0 = max(0, block.rect.x0 - shiftX);
+			int x1 = min(static_cast<int>(m_width), block.rect.x1 - shiftX);
+			int y0 = max(0, block.rect.y0 - shiftY);
+			int y1 = min(static_cast<int>(m_height), block.rect.y1 - shiftY);
+			for (int y = y0; y < y1 && x0 < x1; y++)
+			{
+				const unsigned char* from = &block.pixels[((y + shiftY - block.rect.y0) * blockWidth + x0 + shiftX - block.rect.x0) * 4];
+				copy(from, from + (x1 - x0) * 4, m_background.begin() + (y * m_width + x0) * 4);
+			}
+		}
+	}
+	return true;
+}
+
+const SoftwareRenderer::BackgroundBlock& SoftwareRenderer::getBackgroundBlock(const RenderSnapshot& snapshot, int blockX,
+	int blockY, bool& isNew)
+{
+	for (size_t k = 0; k < m_backgroundBlocks.size(); k++)
+		if (m_backgroundBlocks[k].x == blockX && m_backgroundBlocks[k].y == blockY)
+			return m_backgroundBlocks[k];
+
+	//The block's fields on the board, with rows from the top to the bottom. Neighbouring blocks
+	//round their common edge the same way, so they meet without a gap.
+	isNew = true;
+	m_backgroundBlocks.push_back(BackgroundBlock());
+	BackgroundBlock& block = m_backgroundBlocks.back();
+	block.x = blockX;
+	block.y = blockY;
+	int fieldX1 = min((blockX + 1) * BACKGROUND_BLOCK_SIZE, snapshot.boardWidth);
+	int fieldY1 = min((blockY + 1) * BACKGROUND_BLOCK_SIZE, snapshot.boardHeight);
+	block.rect.x0 = static_cast<int>(floor(m_fieldOriginX + (blockX * BACKGROUND_BLOCK_SIZE - 0.5) * m_fieldWidth + 0.5));
+	block.rect.x1 = static_cast<int>(floor(m_fieldOriginX + (fieldX1 - 0.5) * m_fieldWidth + 0.5));
+	block.rect.y0 = static_cast<int>(floor(m_fieldOriginY - (fieldY1 - 0.5) * m_fieldHeight + 0.5));
+	block.rect.y1 = static_cast<int>(floor(m_fieldOriginY - (blockY * BACKGROUND_BLOCK_SIZE - 0.5) * m_fieldHeight + 0.5));
+	//Along the edges of the board, as far as the sprites on the outermost fields reach
+	if (blockX == 0)
+		block.rect.x0 -= m_tileWidth;
+	if (fieldX1 == snapshot.boardWidth)
+		block.rect.x1 += m_tileWidth;
+	if (fieldY1 == snapshot.boardHeight)
+		block.rect.y0 -= m_tileHeight;
+	if (blockY == 0)
+		block.rect.y1 += m_tileHeight;
+	block.pixels.assign((block.rect.x1 - block.rect.x0) * (block.rect.y1 - block.rect.y0) * 4, 0);
+
+	//Walls on the fields around the block may reach into it, the snapshot has them as well
+	vector<PlacedSprite> placed;
+	placeSprites(snapshot, true, 0, 0, placed);
+	for (size_t k = 0; k < placed.size(); k++)
+	{
+		const Rect& rect = placed[k].rect;
+		if (rect.x0 < block.rect.x1 && rect.x1 > block.rect.x0 && rect.y0 < block.rect.y1 && rect.y1 > block.rect.y0)
+			drawTile(*placed[k].tile, rect.x0, rect.y0, block.rect, block.pixels, block.rect);
+	}
+	return block;
+}
+
+void SoftwareRenderer::placeSprites(const RenderSnapshot& snapshot, bool background, int shiftX, int shiftY,
+	vector<PlacedSprite>& placed)
+{
+	for (size_t k = 0; k < snapshot.sprites.size(); k++)
+	{
+		const RenderSprite& sprite = snapshot.sprites[k];
+		if (!sprite.visible || sprite.background != background || getImage(sprite.imageID, sprite.frame) == nullptr)
+			continue;
+
+		PlacedSprite p;
+		p.id = sprite.id;
+		p.imageID = sprite.imageID;
+		p.frame = sprite.frame % m_images[sprite.imageID].size();
+		switch (sprite.direction)
+		{
+			case GraphObject::up:		p.rotation = face_up;		break;
+			case GraphObject::down:		p.rotation = face_down;		break;
+			case GraphObject::left:		p.rotation = face_left;		break;
+			default:					p.rotation = face_right;	break;
+		}
+		p.tile = &getTile(sprite.imageID, p.frame, p.rotation);
+
+		//Placed with the camera at 0, 0 first, then moved by the camera's whole pixels
+		double centerX = m_fieldOriginX + sprite.x * m_fieldWidth;
+		double centerY = m_fieldOriginY - sprite.y * m_fieldHeight;
+		p.rect.x0 = static_cast<int>(floor(centerX - p.tile->width / 2.0 + 0.5)) - shiftX;
+		p.rect.y0 = static_cast<int>(floor(centerY - p.tile->height / 2.0 + 0.5)) - shiftY;
+		p.rect.x1 = p.rect.x0 + p.tile->width;
+		p.rect.y1 = p.rect.y0 + p.tile->height;
+		placed.push_back(p);
+	}
+}
+
+void SoftwareRenderer::markChangedSprites()
+{
+	//Pair the sprites of both frames up by their object. One that moved, turned, shows another
+	//frame, appeared or disappeared dirties where it was and where it is now.
+	sort(m_lastSprites.begin(), m_lastSprites.end(), [](const PlacedSprite& a, const PlacedSprite& b) { return a.id < b.id; });
+	for (size_t k = 0; k < m_sprites.size(); k++)
+	{
+		const PlacedSprite& sprite = m_sprites[k];
+		vector<PlacedSprite>::iterator last = lower_bound(m_lastSprites.begin(), m_lastSprites.end(), sprite.id,
+			[](const PlacedSprite& a, size_t id) { return a.id < id; });
+		if (last == m_lastSprites.end() || last->id != sprite.id)
+		{
+			markDirty(sprite.rect);
+			continue;
+		}
+
+		if (last->imageID != sprite.imageID || last->frame != sprite.frame || last->rotation != sprite.rotation ||
+			last->rect.x0 != sprite.rect.x0 || last->rect.y0 != sprite.rect.y0)
+		{
+			markDirty(last->rect);
+			markDirty(sprite.rect);
+		}
+		//Paired, whatever is left unpaired afterwards has disappeared
+		last->imageID = -1;
+	}
+
+	for (size_t k = 0; k < m_lastSprites.size(); k++)
+		if (m_lastSprites[k].imageID != -1)
+			markDirty(m_lastSprites[k].rect);
+}
+
+void SoftwareRenderer::markDirty(const Rect& rect)
+{
+	int x1 = min(static_cast<int>(m_width), rect.x1);
+	int y1 = min(static_cast<int>(m_height), rect.y1);
+	if (x1 <= 0 || y1 <= 0 || rect.x0 >= x1 || rect.y0 >= y1)
+		return;
+
+	int bx0 = max(0, rect.x0) / DIRTY_BLOCK_SIZE;
+	int by0 = max(0, rect.y0) / DIRTY_BLOCK_SIZE;
+	for (int by = by0; by <= (y1 - 1) / DIRTY_BLOCK_SIZE; by++)
+		for (int bx = bx0; bx <= (x1 - 1) / DIRTY_BLOCK_SIZE; bx++)
+			m_dirtyBlocks[by * m_nBlocksX + bx] = 1;
+}
+
+void SoftwareRenderer::redrawDirtyBlocks()
+{
+	//Each run of dirty blocks in a row starts as the background again, then gets every sprite
+	//that reaches into it, in the same order a full redraw would draw them
+	const Rect all = { 0, 0, static_cast<int>(m_width), static_cast<int>(m_height) };
+	for (unsigned int by = 0; by < m_nBlocksY; by++)
+	{
+		char* flags = &m_dirtyBlocks[by * m_nBlocksX];
+		for (unsigned int bx = 0; bx < m_nBlocksX; )
+		{
+			if (!flags[bx])
+			{
+				bx++;
+				continue;
+			}
+			unsigned int runStart = bx;
+			while (bx < m_nBlocksX && flags[bx])
+				flags[bx++] = 0;
+
+			Rect run;
+			run.x0 = runStart * DIRTY_BLOCK_SIZE;
+			run.y0 = by * DIRTY_BLOCK_SIZE;
+			run.x1 = min(bx * DIRTY_BLOCK_SIZE, m_width);
+			run.y1 = min((by + 1) * DIRTY_BLOCK_SIZE, m_height);
+			for (int y = run.y0; y < run.y1; y++)
+			{
+				size_t at = (y * m_width + run.x0) * 4;
+				copy(m_background.begin() + at, m_background.begin() + at + (run.x1 - run.x0) * 4, m_pixels.begin() + at);
+			}
+
+			for (size_t k = 0; k < m_sprites.size(); k++)
+			{
+				const PlacedSprite& sprite = m_sprites[k];
+				if (sprite.rect.x0 < run.x1 && sprite.rect.x1 > run.x0 && sprite.rect.y0 < run.y1 && sprite.rect.y1 > run.y0)
+					drawTile(*sprite.tile, sprite.rect.x0, sprite.rect.y0, run, m_pixels, all);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::drawTile(const Tile& tile, int x0, int y0, const Rect& clip, vector<unsigned char>& target,
+	const Rect& targetRect)
+{
+	//Only the part inside the clip rectangle, which never reaches outside the target's pixels
+	int fromX = max(0, clip.x0 - x0);
+	int toX = min(static_cast<int>(tile.width), clip.x1 - x0);
+	int fromY = max(0, clip.y0 - y0);
+	int toY = min(static_cast<int>(tile.height), clip.y1 - y0);
+	if (fromX >= toX)
+		return;
+
+	for (int y = fromY; y < toY; y++)
+	{
+		unsigned char* dst = &target[((y0 + y - targetRect.y0) * (targetRect.x1 - targetRect.x0) + x0 + fromX - targetRect.x0) * 4];
+		const unsigned char* src = &tile.pixels[(y * tile.width + fromX) * 4];
+		blendRow(dst, src, toX - fromX);
+	}
+}
+
+const SoftwareRenderer::TextLayout& SoftwareRenderer::layOutText(TextLayout& layout, const string& text, int centerX,
+	int baselineY, double scale) const
+{
+	if (text == layout.text && centerX == layout.centerX && baselineY == layout.baselineY && scale == layout.scale)
+		return layout;
+	layout.text = text;
+	layout.centerX = centerX;
+	layout.baselineY = baselineY;
+	layout.scale = scale;
+	layout.blocks.clear();
+	Rect none = { 0, 0, 0, 0 };
+	layout.bounds = none;
+	if (text.empty())
+		return layout;
+
+	//Lines too long for the framebuffer are drawn smaller, like the OpenGL renderer's narrower
+	//stroke font would fit them
+	scale = min(scale, 0.98 * m_width / (text.size() * GLYPH_ADVANCE));
+	double x0 = centerX - text.size() * GLYPH_ADVANCE * scale / 2;
+	double top = baselineY - GLYPH_ASCENT * scale;
+	layout.bounds.x0 = max(0, static_cast<int>(floor(x0 + 0.5)));
+	layout.bounds.y0 = max(0, static_cast<int>(floor(top + 0.5)));
+	layout.bounds.x1 = min(static_cast<int>(m_width), static_cast<int>(floor(x0 + text.size() * GLYPH_ADVANCE * scale + 0.5)));
+	layout.bounds.y1 = min(static_cast<int>(m_height), static_cast<int>(floor(top + 8 * scale + 0.5)));
+
+	for (size_t k = 0; k < text.size(); k++)
+	{
+		unsigned char ch = static_cast<unsigned char>(text[k]);
+		if (ch < ' ' || ch > '~')
+			ch = '?';
+		const unsigned char* glyph = FONT[ch - ' '];
+		for (int column = 0; column < GLYPH_WIDTH; column++)
+		{
+			//Every font pixel is a block of about scale x scale pixels, and the pixels one above
+			//the other in a column become one rectangle
+			Rect block;
+			block.x0 = max(layout.bounds.x0, static_cast<int>(floor(x0 + (k * GLYPH_ADVANCE + column) * scale + 0.5)));
+			block.x1 = min(layout.bounds.x1, static_cast<int>(floor(x0 + (k * GLYPH_ADVANCE + column + 1) * scale + 0.5)));
+			for (int row = 0; row < 8; )
+			{
+				if ((glyph[column] >> row & 1) == 0)
+				{
+					row++;
+					continue;
+				}
+				int firstRow = row;
+				while (row < 8 && (glyph[column] >> row & 1) != 0)
+					row++;
+
+				block.y0 = max(layout.bounds.y0, static_cast<int>(floor(top + firstRow * scale + 0.5)));
+				block.y1 = min(layout.bounds.y1, static_cast<int>(floor(top + row * scale + 0.5)));
+				if (block.x0 < block.x1 && block.y0 < block.y1)
+					layout.blocks.push_back(block);
+			}
+		}
+	}
+	return layout;
+}
+
+void SoftwareRenderer::drawText(const TextLayout& layout, unsigned int bgra)
+{
+	unsigned int* pixels = reinterpret_cast<unsigned int*>(&m_pixels[0]);
+	for (size_t k = 0; k < layout.blocks.size(); k++)
+	{
+		const Rect& block = layout.blocks[k];
+		for (int y = block.y0; y < block.y1; y++)
+			fill(pixels + y * m_width + block.x0, pixels + y * m_width + block.x1, bgra);
+	}
+}
+
+void SoftwareRenderer::clear()
+{
+	fill(m_pixels.begin(), m_pixels.end(), 0);
+}
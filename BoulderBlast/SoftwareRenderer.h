@@ -0,0 +1,139 @@
+#ifndef SOFTWARERENDERER_H_
+#define SOFTWARERENDERER_H_
+
+#include "RenderSnapshot.h"
+#include "TgaImage.h"
+#include <string>
+#include <vector>
+
+//Draws render snapshots into a framebuffer in memory, without OpenGL or a display, with the same
+//layout as the OpenGL renderer in the window. Sprites are scaled and rotated once per size they
+//are drawn at, after that every sprite in a frame is a plain alpha blended copy. Walls, holes and
+//exits are drawn into background blocks in board coordinates only when they come into view or change,
+//a scrolled frame just copies them to where the camera puts them. A frame with the same background
+//and camera as the one before only redraws the blocks of pixels where a sprite or the HUD changed.
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer(unsigned int width, unsigned int height);
+
+	//Same as SpriteManager::loadSprite and addSprite, so both load the same frames
+	bool loadSprite(std::string filename_tga, int imageID, int frameNum);
+	bool addSprite(const SpriteImage& image, int imageID, int frameNum);
+
+	void render(const RenderSnapshot& snapshot);
+
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+
+	//The last frame rendered, BGRA with 4 bytes per pixel, rows from the top to the bottom
+	const std::vector<unsigned char>& getPixels() const { return m_pixels; }
+
+	//Writes the last frame rendered as a binary PPM file
+	bool writePpm(const std::string& filename) const;
+
+private:
+	//A sprite frame scaled and rotated to the size it is drawn at, with premultiplied alpha
+	struct Tile
+	{
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	enum Rotation { face_right, face_left, face_up, face_down, nRotations };
+
+	//Pixels from x0, y0 up to but not including x1, y1
+	struct Rect
+	{
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+	};
+
+	//The pixels of the walls, holes and exits in one block of the board, where the frame would show
+	//them with the camera at 0, 0
+	struct BackgroundBlock
+	{
+		int x;
+		int y;
+		Rect rect;
+		std::vector<unsigned char> pixels;
+	};
+
+	//A sprite as it is drawn into the frame, frame already reduced to the image's frames
+	struct PlacedSprite
+	{
+		size_t id;
+		int imageID;
+		unsigned int frame;
+		Rotation rotation;
+		const Tile* tile;
+		Rect rect;
+	};
+
+	//A line of text laid out into the rectangles its font pixels fill, kept until the text or
+	//its place changes
+	struct TextLayout
+	{
+		std::string text;
+		int centerX;
+		int baselineY;
+		double scale;
+		Rect bounds;
+		std::vector<Rect> blocks;
+
+		TextLayout() : text(), centerX(0), baselineY(0), scale(0), bounds(), blocks() {}
+	};
+
+	const SpriteImage* getImage(int imageID, int frame) const;
+	const Tile& getTile(int imageID, int frame, Rotation rotation);
+	void drawGamePlay(const RenderSnapshot& snapshot);
+	bool updateBackground(const RenderSnapshot& snapshot);
+	const BackgroundBlock& getBackgroundBlock(const RenderSnapshot& snapshot, int blockX, int blockY, bool& isNew);
+	void placeSprites(const RenderSnapshot& snapshot, bool background, int shiftX, int shiftY, std::vector<PlacedSprite>& placed);
+	void markChangedSprites();
+	void markDirty(const Rect& rect);
+	void redrawDirtyBlocks();
+	void drawTile(const Tile& tile, int x0, int y0, const Rect& clip, std::vector<unsigned char>& target, const Rect& targetRect);
+	const TextLayout& layOutText(TextLayout& layout, const std::string& text, int centerX, int baselineY, double scale) const;
+	void drawText(const TextLayout& layout, unsigned int bgra);
+	void clear();
+
+private:
+	unsigned int m_width;
+	unsigned int m_height;
+	std::vector<unsigned char> m_pixels;
+	std::vector<unsigned char> m_background;
+	BackgroundKey m_backgroundKey;
+	std::vector<BackgroundBlock> m_backgroundBlocks;
+	//Where the centre of field 0, 0 is drawn with the camera at 0, 0 and how far apart fields are,
+	//in pixels. The camera moves everything by whole pixels, so background and sprites stay aligned.
+	double m_fieldOriginX;
+	double m_fieldOriginY;
+	double m_fieldWidth;
+	double m_fieldHeight;
+	int m_cameraShiftX;
+	int m_cameraShiftY;
+	Rect m_backgroundRange;
+
+	//What the last frame drew over the background, to find what changed since
+	bool m_isGamePlayShown;
+	std::vector<PlacedSprite> m_sprites;
+	std::vector<PlacedSprite> m_lastSprites;
+	TextLayout m_statLayout;
+	TextLayout m_promptLayouts[2];
+
+	//One flag per DIRTY_BLOCK_SIZE x DIRTY_BLOCK_SIZE block of pixels that must be redrawn
+	std::vector<char> m_dirtyBlocks;
+	unsigned int m_nBlocksX;
+	unsigned int m_nBlocksY;
+	//Frames per image ID, and tiles per frame and rotation for the current tile size
+	std::vector<std::vector<SpriteImage> > m_images;
+	std::vector<std::vector<Tile> > m_tiles;
+	unsigned int m_tileWidth;
+	unsigned int m_tileHeight;
+};
+
+#endif // SOFTWARERENDERER_H_
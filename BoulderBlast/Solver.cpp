@@ -0,0 +1,559 @@
+#include "Solver.h"
+#include "TaskScheduler.h"
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+	const char MOVE_NAMES[4] = { 'U', 'D', 'L', 'R' };
+	const char SHOT_NAME = 'F';
+	const int DELTA_X[4] = { 0, 0, -1, 1 };
+	const int DELTA_Y[4] = { 1, -1, 0, 0 };
+	const int OPPOSITE[4] = { 1, 0, 3, 2 };
+
+	//As in the game: the player starts with 20 bullets, an ammunition goodie gives 20 more and
+	//a boulder has 10 hit points of which every bullet takes 2
+	const unsigned long long START_AMMUNITION = 20;
+	const unsigned long long GOODIE_AMMUNITION = 20;
+	const unsigned long long SHOTS_PER_BOULDER = 5;
+
+	//A step is the floor field it starts from times 8 plus the direction, plus 4 for a shot
+	const unsigned int SHOT_STEP = 4;
+
+	//How many steps a jewel that is still to be collected counts for when choosing which states
+	//to expand next. Higher weights head for the jewels more greedily, but also get stuck longer
+	//in the states that took a jewel in a way that leaves no boulder for a later one.
+	const size_t JEWEL_WEIGHT = 2;
+
+	const unsigned int N_SHARDS = 64;
+	const size_t STATES_PER_TASK = 512;
+	const unsigned int NO_PARENT = 0xffffffff;
+	const unsigned int NO_GOAL = 0xffffffff;
+
+	//Transposition table: every state ever reached, split into independently locked shards.
+	//A state's id is its index inside its shard times N_SHARDS plus the shard number.
+	class StateTable
+	{
+	public:
+		StateTable(size_t nWords, size_t maxStates)
+			: m_nWords(nWords), m_maxStates(maxStates), m_nStates(0), m_full(false) {}
+
+		//Returns true and the id of the state if it has not been seen before
+		bool insert(const unsigned long long* state, unsigned int parent, unsigned int step, unsigned int& id)
+		{
+			unsigned long long hash = hashState(state);
+			Shard& shard = m_shards[hash % N_SHARDS];
+			hash /= N_SHARDS;
+
+			lock_guard<mutex> lock(shard.mutex);
+			if (shard.table.size() < 2 * (shard.hashes.size() + 1))
+				grow(shard);
+
+			//Linear probing, slots hold the index inside the shard plus one
+			size_t mask = shard.table.size() - 1;
+			for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+			{
+				unsigned int entry = shard.table[slot];
+				if (entry == 0)
+				{
+					if (m_nStates++ >= m_maxStates)
+					{
+						m_full = true;
+						return false;
+					}
+					unsigned int index = static_cast<unsigned int>(shard.hashes.size());
+					shard.table[slot] = index + 1;
+					shard.hashes.push_back(hash);
+					shard.states.insert(shard.states.end(), state, state + m_nWords);
+					shard.parents.push_back(parent);
+					shard.steps.push_back(step);
+					id = index * N_SHARDS + static_cast<unsigned int>(&shard - m_shards);
+					return true;
+				}
+				if (shard.hashes[entry - 1] == hash &&
+					equal(state, state + m_nWords, shard.states.begin() + (entry - 1) * m_nWords))
+					return false;
+			}
+		}
+
+		void get(unsigned int id, unsigned long long* state)
+		{
+			Shard& shard = m_shards[id % N_SHARDS];
+			lock_guard<mutex> lock(shard.mutex);
+			vector<unsigned long long>::const_iterator first = shard.states.begin() + (id / N_SHARDS) * m_nWords;
+			copy(first, first + m_nWords, state);
+		}
+
+		//Only to be used once the search is over
+		unsigned int getParent(unsigned int id, unsigned int& step) const
+		{
+			const Shard& shard = m_shards[id % N_SHARDS];
+			step = shard.steps[id / N_SHARDS];
+			return shard.parents[id / N_SHARDS];
+		}
+
+		size_t size() const
+		{
+			return min(m_nStates.load(), m_maxStates);
+		}
+
+		bool isFull() const
+		{
+			return m_full;
+		}
+
+	private:
+		struct Shard
+		{
+			std::mutex					mutex;
+			vector<unsigned long long>	states;
+			vector<unsigned long long>	hashes;
+			vector<unsigned int>		parents;
+			vector<unsigned int>		steps;		//floor field times 8 plus direction plus SHOT_STEP
+			vector<unsigned int>		table;
+		};
+
+		unsigned long long hashState(const unsigned long long* state) const
+		{
+			unsigned long long hash = 0;
+			for (size_t i = 0; i < m_nWords; i++)
+			{
+				hash = (hash ^ state[i]) * 0x9e3779b97f4a7c15ULL;
+				hash ^= hash >> 29;
+			}
+			return hash;
+		}
+
+		void grow(Shard& shard)
+		{
+			vector<unsigned int> table(max<size_t>(1024, shard.table.size() * 2), 0);
+			size_t mask = table.size() - 1;
+			for (size_t i = 0; i < shard.hashes.size(); i++)
+			{
+				size_t slot = shard.hashes[i] & mask;
+				while (table[slot] != 0)
+					slot = (slot + 1) & mask;
+				table[slot] = static_cast<unsigned int>(i + 1);
+			}
+			shard.table.swap(table);
+		}
+
+		size_t			m_nWords;
+		size_t			m_maxStates;
+		atomic<size_t>	m_nStates;
+		atomic<bool>	m_full;
+		Shard			m_shards[N_SHARDS];
+	};
+}
+
+Solver::Solver(const Level& level)
+	: m_nFloors(0), m_nHoles(0), m_nJewels(0), m_nPickups(0), m_nWords(0), m_exitFloor(-1), m_playerFloor(-1),
+	  m_hasRobots(false)
+{
+	//Give every field a floor index, unless nothing can ever stand on it
+	vector<int> floorOf(level.getWidth() * level.getHeight(), -1);
+	for (int y = 0; y < level.getHeight(); y++)
+		for (int x = 0; x < level.getWidth(); x++)
+		{
+			Level::MazeEntry entry = level.getContentsOf(x, y);
+			if (entry != Level::wall && entry != Level::kleptobot_factory && entry != Level::angry_kleptobot_factory)
+				floorOf[y * level.getWidth() + x] = m_nFloors++;
+		}
+
+	m_neighbors.assign(m_nFloors * 4, -1);
+	m_holeIndex.assign(m_nFloors, -1);
+	m_pickupIndex.assign(m_nFloors, -1);
+	vector<int> boulders, jewels, goodies;
+	vector<char> isAmmo;
+
+	for (int y = 0; y < level.getHeight(); y++)
+		for (int x = 0; x < level.getWidth(); x++)
+		{
+			Level::MazeEntry entry = level.getContentsOf(x, y);
+			if (entry == Level::horiz_snarlbot || entry == Level::vert_snarlbot ||
+				entry == Level::kleptobot_factory || entry == Level::angry_kleptobot_factory)
+				m_hasRobots = true;
+
+			int floor = floorOf[y * level.getWidth() + x];
+			if (floor < 0)
+				continue;
+
+			for (int dir = 0; dir < 4; dir++)
+			{
+				int nx = x + DELTA_X[dir], ny = y + DELTA_Y[dir];
+				if (nx >= 0 && nx < level.getWidth() && ny >= 0 && ny < level.getHeight())
+					m_neighbors[floor * 4 + dir] = floorOf[ny * level.getWidth() + nx];
+			}
+
+			switch (entry)
+			{
+			case Level::player:
+				m_playerFloor = floor;
+				break;
+			case Level::exit:
+				m_exitFloor = floor;
+				break;
+			case Level::boulder:
+				boulders.push_back(floor);
+				break;
+			case Level::hole:
+				m_holeIndex[floor] = m_nHoles++;
+				break;
+			case Level::jewel:
+				jewels.push_back(floor);
+				break;
+			case Level::restore_health:
+			case Level::extra_life:
+			case Level::ammo:
+				goodies.push_back(floor);
+				isAmmo.push_back(entry == Level::ammo);
+				break;
+			default:
+				break;
+			}
+		}
+
+	m_nJewels = static_cast<int>(jewels.size());
+	for (size_t i = 0; i < jewels.size(); i++)
+		m_pickupIndex[jewels[i]] = m_nPickups++;
+	m_isAmmo.assign(m_nPickups, 0);
+	m_isAmmo.insert(m_isAmmo.end(), isAmmo.begin(), isAmmo.end());
+	for (size_t i = 0; i < goodies.size(); i++)
+		m_pickupIndex[goodies[i]] = m_nPickups++;
+
+	//Boulder bits first, then hole bits, then pickup bits, then the ammunition and the player's word
+	m_nWords = (m_nFloors + m_nHoles + m_nPickups + 63) / 64 + 2;
+	m_start.assign(m_nWords, 0);
+	for (size_t i = 0; i < boulders.size(); i++)
+		setBit(&m_start[0], boulders[i], true);
+	for (int i = 0; i < m_nHoles + m_nPickups; i++)
+		setBit(&m_start[0], m_nFloors + i, true);
+	m_start[m_nWords - 2] = START_AMMUNITION;
+}
+
+bool Solver::isWalkable(const unsigned long long* state, int floor) const
+{
+	if (floor < 0 || testBit(state, floor))
+		return false;
+	int hole = m_holeIndex[floor];
+	int pickup = m_pickupIndex[floor];
+	return !(hole >= 0 && testBit(state, m_nFloors + hole)) &&
+		!(pickup >= 0 && testBit(state, m_nFloors + m_nHoles + pickup));
+}
+
+bool Solver::canTakeBoulder(const unsigned long long* state, int floor) const
+{
+	//A boulder can only be pushed onto a field without any other actor or into a hole
+	if (floor < 0 || floor == m_exitFloor || testBit(state, floor))
+		return false;
+	int pickup = m_pickupIndex[floor];
+	return !(pickup >= 0 && testBit(state, m_nFloors + m_nHoles + pickup));
+}
+
+int Solver::findReachable(const unsigned long long* state, int from, vector<char>& reachable, int* pickupMove) const
+{
+	reachable.assign(m_nFloors, 0);
+	vector<int> open(1, from);
+	open.reserve(m_nFloors);
+	reachable[from] = 1;
+	int lowest = from;
+	if (pickupMove != nullptr)
+		*pickupMove = -1;
+	while (!open.empty())
+	{
+		int floor = open.back();
+		open.pop_back();
+		lowest = min(lowest, floor);
+		for (int dir = 0; dir < 4; dir++)
+		{
+			int next = m_neighbors[floor * 4 + dir];
+			if (next < 0 || reachable[next])
+				continue;
+			if (!isWalkable(state, next))
+			{
+				if (pickupMove != nullptr && m_pickupIndex[next] >= 0 &&
+					testBit(state, m_nFloors + m_nHoles + m_pickupIndex[next]))
+					*pickupMove = floor * 4 + dir;
+				continue;
+			}
+			reachable[next] = 1;
+			open.push_back(next);
+		}
+	}
+	return lowest;
+}
+
+int Solver::collect(unsigned long long* state, int& player, vector<char>& reachable, string* moves) const
+{
+	for (;;)
+	{
+		int pickupMove;
+		int lowest = findReachable(state, player, reachable, &pickupMove);
+		if (pickupMove < 0)
+			return lowest;
+
+		int from = pickupMove / 4, dir = pickupMove % 4;
+		int pickup = m_pickupIndex[m_neighbors[pickupMove]];
+		if (moves != nullptr)
+		{
+			appendWalk(state, player, from, *moves);
+			*moves += MOVE_NAMES[dir];
+		}
+		setBit(state, m_nFloors + m_nHoles + pickup, false);
+		if (m_isAmmo[pickup])
+			state[m_nWords - 2] += GOODIE_AMMUNITION;
+		player = m_neighbors[from * 4 + dir];
+	}
+}
+
+bool Solver::push(const unsigned long long* state, int from, int dir, unsigned long long* next) const
+{
+	int target = m_neighbors[from * 4 + dir];
+	if (target < 0)
+		return false;
+
+	if (!testBit(state, target))
+		return false;
+	int behind = m_neighbors[target * 4 + dir];
+	if (!canTakeBoulder(state, behind))
+		return false;
+
+	copy(state, state + m_nWords, next);
+	setBit(next, target, false);
+	int behindHole = m_holeIndex[behind];
+	if (behindHole >= 0 && testBit(state, m_nFloors + behindHole))
+		setBit(next, m_nFloors + behindHole, false);	//both the boulder and the hole are gone
+	else
+		setBit(next, behind, true);
+	next[m_nWords - 1] = target;
+	return true;
+}
+
+bool Solver::canTurn(const unsigned long long* state, int from, int dir) const
+{
+	int target = m_neighbors[from * 4 + dir];
+	if (target < 0)
+		return true;
+	int hole = m_holeIndex[target];
+	if (hole >= 0 && testBit(state, m_nFloors + hole))
+		return true;
+	return testBit(state, target) && !canTakeBoulder(state, m_neighbors[target * 4 + dir]);
+}
+
+int Solver::shoot(const unsigned long long* state, const vector<char>& reachable, int from, int dir,
+	unsigned long long* next) const
+{
+	if (state[m_nWords - 2] < SHOTS_PER_BOULDER)
+		return -1;
+	int behind = m_neighbors[from * 4 + OPPOSITE[dir]];
+	if (!canTurn(state, from, dir) && !(behind >= 0 && reachable[behind]))
+		return -1;
+
+	//Bullets fly over holes, jewels, goodies and the exit and stop at walls and factories
+	int target = m_neighbors[from * 4 + dir];
+	while (target >= 0 && !testBit(state, target))
+		target = m_neighbors[target * 4 + dir];
+	if (target < 0)
+		return -1;
+
+	copy(state, state + m_nWords, next);
+	setBit(next, target, false);
+	next[m_nWords - 2] -= SHOTS_PER_BOULDER;
+	next[m_nWords - 1] = from;
+	return target;
+}
+
+int Solver::countJewels(const unsigned long long* state) const
+{
+	int nJewels = 0;
+	for (int i = 0; i < m_nJewels; i++)
+		if (testBit(state, m_nFloors + m_nHoles + i))
+			nJewels++;
+	return nJewels;
+}
+
+bool Solver::isGoal(const unsigned long long* state, const vector<char>& reachable) const
+{
+	return reachable[m_exitFloor] && countJewels(state) == 0;
+}
+
+void Solver::appendWalk(const unsigned long long* state, int from, int to, string& moves) const
+{
+	//Breadth first over the fields the player can walk on, remembering how each was entered
+	vector<int> cameFrom(m_nFloors, -1);
+	vector<int> open(1, from);
+	cameFrom[from] = from * 4;
+	for (size_t i = 0; i < open.size() && cameFrom[to] < 0; i++)
+		for (int dir = 0; dir < 4; dir++)
+		{
+			int next = m_neighbors[open[i] * 4 + dir];
+			if (next < 0 || cameFrom[next] >= 0 || !isWalkable(state, next))
+				continue;
+			cameFrom[next] = open[i] * 4 + dir;
+			open.push_back(next);
+		}
+
+	string walk;
+	for (int floor = to; floor != from; floor = cameFrom[floor] / 4)
+		walk += MOVE_NAMES[cameFrom[floor] % 4];
+	moves.append(walk.rbegin(), walk.rend());
+}
+
+Solver::Result Solver::solve(TaskScheduler& scheduler, size_t maxStates) const
+{
+	Result result;
+	result.solvable = false;
+	result.gaveUp = false;
+	result.isExact = !m_hasRobots;
+	result.nSteps = 0;
+	result.nStates = 0;
+	if (m_exitFloor < 0 || m_playerFloor < 0)
+		return result;
+
+	//The player's position only matters up to the area that can be walked around in
+	vector<unsigned long long> start(m_start);
+	vector<char> reachable;
+	int player = m_playerFloor;
+	start[m_nWords - 1] = collect(&start[0], player, reachable, nullptr);
+
+	StateTable table(m_nWords, maxStates);
+	unsigned int startId;
+	table.insert(&start[0], NO_PARENT, 0, startId);
+
+	atomic<unsigned int> goalId(isGoal(&start[0], reachable) ? startId : NO_GOAL);
+
+	//Best first: a state's priority is the number of steps that led to it plus JEWEL_WEIGHT for
+	//every jewel still to collect, and the whole layer of the states with the lowest priority is
+	//expanded at once. So the search heads for the jewels instead of trying every way to move
+	//the boulders around first, but still falls back to other states when that leads nowhere.
+	vector<vector<unsigned int> > open(JEWEL_WEIGHT * countJewels(&start[0]) + 1);
+	open.back().push_back(startId);
+
+	vector<unsigned int> frontier;
+	for (;;)
+	{
+		size_t priority = 0;
+		while (priority < open.size() && open[priority].empty())
+			priority++;
+		if (priority == open.size() || goalId != NO_GOAL || table.isFull())
+			break;
+		frontier.clear();
+		frontier.swap(open[priority]);
+
+		size_t nTasks = (frontier.size() + STATES_PER_TASK - 1) / STATES_PER_TASK;
+		vector<vector<pair<size_t, unsigned int> > > nextStates(nTasks);
+		TaskGroup group(scheduler);
+		for (size_t t = 0; t < nTasks; t++)
+		{
+			group.run([&, t]()
+			{
+				vector<unsigned long long> state(m_nWords), next(m_nWords);
+				vector<char> reachable, nextReachable, isShotDown;
+				size_t end = min(frontier.size(), (t + 1) * STATES_PER_TASK);
+				for (size_t i = t * STATES_PER_TASK; i < end && goalId == NO_GOAL; i++)
+				{
+					table.get(frontier[i], &state[0]);
+					int nJewels = countJewels(&state[0]);
+					findReachable(&state[0], static_cast<int>(state[m_nWords - 1]), reachable);
+					isShotDown.assign(m_nFloors, 0);
+					for (int from = 0; from < m_nFloors; from++)
+					{
+						if (!reachable[from])
+							continue;
+						for (unsigned int step = from * 8; step < static_cast<unsigned int>(from) * 8 + 8; step++)
+						{
+							int dir = step % 4;
+							if (step & SHOT_STEP)
+							{
+								//Shooting the same boulder from somewhere else leads to the same state
+								int target = shoot(&state[0], reachable, from, dir, &next[0]);
+								if (target < 0 || isShotDown[target])
+									continue;
+								isShotDown[target] = 1;
+							}
+							else if (!push(&state[0], from, dir, &next[0]))
+								continue;
+							int player = static_cast<int>(next[m_nWords - 1]);
+							next[m_nWords - 1] = collect(&next[0], player, nextReachable, nullptr);
+
+							unsigned int id;
+							if (!table.insert(&next[0], frontier[i], step, id))
+								continue;
+							size_t nextPriority = priority + 1 - JEWEL_WEIGHT * (nJewels - countJewels(&next[0]));
+							nextStates[t].push_back(make_pair(nextPriority, id));
+							if (isGoal(&next[0], nextReachable))
+							{
+								unsigned int none = NO_GOAL;
+								goalId.compare_exchange_strong(none, id);
+							}
+						}
+					}
+				}
+			});
+		}
+		group.wait();
+
+		for (size_t t = 0; t < nTasks; t++)
+			for (size_t i = 0; i < nextStates[t].size(); i++)
+			{
+				if (nextStates[t][i].first >= open.size())
+					open.resize(nextStates[t][i].first + 1);
+				open[nextStates[t][i].first].push_back(nextStates[t][i].second);
+			}
+	}
+
+	result.nStates = table.size();
+	if (goalId == NO_GOAL)
+	{
+		result.gaveUp = table.isFull();
+		return result;
+	}
+
+	//Follow the parents back to the start, then replay the steps and fill in the walks and
+	//pickups between them
+	vector<unsigned int> steps;
+	for (unsigned int id = goalId; ; )
+	{
+		unsigned int step;
+		unsigned int parent = table.getParent(id, step);
+		if (parent == NO_PARENT)
+			break;
+		steps.push_back(step);
+		id = parent;
+	}
+
+	result.solvable = true;
+	result.nSteps = steps.size();
+	vector<unsigned long long> state(m_start), next(m_nWords);
+	player = m_playerFloor;
+	collect(&state[0], player, reachable, &result.moves);
+	for (size_t i = steps.size(); i-- > 0;)
+	{
+		int from = steps[i] / 8, dir = steps[i] % 4;
+		if (steps[i] & SHOT_STEP)
+		{
+			//Turn on the spot if something is in the way, otherwise step onto the field towards the target
+			if (canTurn(&state[0], from, dir))
+				appendWalk(&state[0], player, from, result.moves);
+			else
+				appendWalk(&state[0], player, m_neighbors[from * 4 + OPPOSITE[dir]], result.moves);
+			result.moves += MOVE_NAMES[dir];
+			result.moves.append(SHOTS_PER_BOULDER, SHOT_NAME);
+			findReachable(&state[0], from, reachable);
+			shoot(&state[0], reachable, from, dir, &next[0]);
+		}
+		else
+		{
+			appendWalk(&state[0], player, from, result.moves);
+			result.moves += MOVE_NAMES[dir];
+			push(&state[0], from, dir, &next[0]);
+		}
+		player = static_cast<int>(next[m_nWords - 1]);
+		state.swap(next);
+		collect(&state[0], player, reachable, &result.moves);
+	}
+	appendWalk(&state[0], player, m_exitFloor, result.moves);
+	return result;
+}
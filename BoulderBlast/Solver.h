@@ -0,0 +1,95 @@
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include "Level.h"
+#include <string>
+#include <vector>
+
+class TaskScheduler;
+
+//Searches the boulder and hole puzzle of a level for a way to collect every jewel and then reach
+//the exit. Boulders are pushed into free fields or into holes or shot down with the player's
+//ammunition. Jewels and goodies are picked up as soon as the player can walk to them, which never
+//takes away a way to go on, and ammunition goodies refill the ammunition. Factories block like
+//walls. Robots are not taken into account at all.
+//The search goes for a solution quickly, not for the shortest one: neither the number of pushes
+//and shots nor the number of moves is minimal.
+class Solver
+{
+public:
+	struct Result
+	{
+		bool		solvable;
+		bool		gaveUp;		//the state limit was reached before the search could decide
+		bool		isExact;	//false if the level has robots, which may block the solution
+								//found or shoot boulders away that the search cannot get rid of
+		std::string	moves;		//one of 'U', 'D', 'L' or 'R' per move or turn of the player and
+								//'F' per shot
+		size_t		nSteps;		//pushes and shots at boulders
+		size_t		nStates;
+	};
+
+	static const size_t DEFAULT_MAX_STATES = 4000000;
+
+	explicit Solver(const Level& level);
+
+	//Best first search, every layer of equally promising states is expanded in parallel on the
+	//scheduler's workers
+	Result solve(TaskScheduler& scheduler, size_t maxStates = DEFAULT_MAX_STATES) const;
+
+private:
+	//Marks the floor fields the player can walk to without pushing or picking up anything and
+	//returns the lowest index among them, which stands for the player's position in a state.
+	//pickupMove is set to a field times 4 plus the direction of a move onto a jewel or goodie,
+	//-1 if there is none.
+	int findReachable(const unsigned long long* state, int from, std::vector<char>& reachable,
+		int* pickupMove = nullptr) const;
+	//Picks up every jewel and goodie the player can walk to, appending the moves if asked to, and
+	//returns what findReachable returns for the state afterwards
+	int collect(unsigned long long* state, int& player, std::vector<char>& reachable, std::string* moves) const;
+	bool isWalkable(const unsigned long long* state, int floor) const;
+	bool canTakeBoulder(const unsigned long long* state, int floor) const;
+	bool push(const unsigned long long* state, int from, int dir, unsigned long long* next) const;
+	//The player can only face a direction without moving there if something is in the way,
+	//otherwise the shot has to be fired right after stepping onto the field in that direction
+	bool canTurn(const unsigned long long* state, int from, int dir) const;
+	//Returns the boulder that was shot down or -1
+	int shoot(const unsigned long long* state, const std::vector<char>& reachable, int from, int dir,
+		unsigned long long* next) const;
+	int countJewels(const unsigned long long* state) const;
+	bool isGoal(const unsigned long long* state, const std::vector<char>& reachable) const;
+	void appendWalk(const unsigned long long* state, int from, int to, std::string& moves) const;
+
+	static bool testBit(const unsigned long long* bits, int index)
+	{
+		return (bits[index >> 6] >> (index & 63) & 1) != 0;
+	}
+
+	static void setBit(unsigned long long* bits, int index, bool value)
+	{
+		if (value)
+			bits[index >> 6] |= 1ULL << (index & 63);
+		else
+			bits[index >> 6] &= ~(1ULL << (index & 63));
+	}
+
+private:
+	//Every field that is not a wall or factory is a floor field and gets an index. A state is
+	//a bit per floor field for boulders, a bit per hole and per jewel and goodie the level
+	//started with, one word with the player's ammunition and one word with the player's position.
+	int									m_nFloors;
+	int									m_nHoles;
+	int									m_nJewels;
+	int									m_nPickups;		//the jewels first, then the goodies
+	size_t								m_nWords;
+	std::vector<int>					m_neighbors;	//4 per floor field, -1 if blocked
+	std::vector<int>					m_holeIndex;	//per floor field, -1 if there is no hole
+	std::vector<int>					m_pickupIndex;	//per floor field, -1 if there is no jewel or goodie
+	std::vector<char>					m_isAmmo;		//per pickup
+	int									m_exitFloor;
+	int									m_playerFloor;
+	bool								m_hasRobots;
+	std::vector<unsigned long long>		m_start;
+};
+
+#endif // SOLVER_H_
@@ -25,6 +25,15 @@ class SoundFXController
 			m_engine->stopAllSounds();
 	}
 
+	  // From now on playClip(soundFile) plays the size bytes at data instead of the
+	  // file. They are not copied and must stay valid while the engine exists.
+	bool addClip(std::string soundFile, const char* data, size_t size)
+	{
+		return m_engine != nullptr &&
+			m_engine->addSoundSourceFromMemory(const_cast<char*>(data), static_cast<irrklang::ik_s32>(size),
+											   soundFile.c_str(), false) != nullptr;
+	}
+
 	static SoundFXController& getInstance();
 
   private:
@@ -63,6 +72,11 @@ class SoundFXController
 	void abortClip()
 	{
 	}
+
+	bool addClip(std::string /* soundFile */, const char* /* data */, size_t /* size */)
+	{
+		return false;	// afplay only plays files
+	}
 	
 	static SoundFXController& getInstance();
 };
@@ -74,6 +88,7 @@ class SoundFXController
   public:
 	void playClip(std::string soundFile) {}
 	void abortClip() {}
+	bool addClip(std::string /* soundFile */, const char* /* data */, size_t /* size */) { return false; }
 	static SoundFXController& getInstance();
 };
 
@@ -2,6 +2,7 @@
 #define SPRITEMANAGER_H_
 
 #include "glut.h"
+#include "TgaImage.h"
 
 #ifndef GL_BGR
 #define GL_BGR GL_BGR_EXT
@@ -12,19 +13,28 @@
 #endif
 
 #include <iostream>
-#include <fstream>
 #include <string>
-#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 
 static const double SPRITE_WIDTH = .67; //.87;
 static const double SPRITE_HEIGHT = .54; //.54;
 
+  // First bytes of an atlas written by SpriteManager::writeAtlas()
+static const char ATLAS_MAGIC[4] = { 'A', 'T', 'L', '1' };
+
+  // All frames of all sprites live in one texture, the atlas, scaled to cells of the
+  // same size. Sprites plotted during a frame are only collected into one vertex array,
+  // drawSprites() then draws all of them with one call and one set of state changes.
+  // Frame counts and where each frame is in the atlas are kept in flat tables indexed
+  // by image ID and frame, so plotting a sprite does no lookups.
 class SpriteManager
 {
 public:
 
 	SpriteManager()
-	 : m_mipMapped(true)
+	 : m_mipMapped(true), m_atlasTextureID(0), m_atlasWidth(0), m_atlasHeight(0), m_cellWidth(0), m_cellHeight(0)
 	{
 	}
 
@@ -33,117 +43,183 @@ public:
 		m_mipMapped = status;
 	}
 
+	  // Only decodes the frame, the atlas is built by buildAtlas() once all are loaded
 	bool loadSprite(std::string filename_tga, int imageID, int frameNum)
 	{
-		  // Load Texture Data From TGA File
+		SpriteImage image;
+		return loadTga(filename_tga, image) && addSprite(image, imageID, frameNum);
+	}
 
+	  // Same for a frame that is already decoded. Frames that look the same once scaled
+	  // to a cell share the cell.
+	bool addSprite(const SpriteImage& image, int imageID, int frameNum)
+	{
 		unsigned int spriteID = getSpriteID(imageID, frameNum);
 		if (INVALID_SPRITE_ID == spriteID)
 			return false;
 
-		m_frameCountPerSprite[imageID]++;	// keep track of how many frames per sprite we loaded
-
-		std::string line;
-		std::string contents = "";
-		std::ifstream tgaFile (filename_tga, std::ios::in|std::ios::binary);
-		if (!tgaFile)
-			return false;
-
-		char type[3];
-		char info[6];
-		unsigned char byteCount;
-		unsigned int textureWidth;
-		unsigned int textureHeight;
-		char* imageData = nullptr;
-		long imageSize;
-
-			// Read file header info
-		tgaFile.read(type, 3);
-		tgaFile.seekg(12);
-		tgaFile.read(info, 6);
-		textureWidth = static_cast<unsigned char>(info[0]) + static_cast<unsigned char>(info[1]) * 256;
-		textureHeight = static_cast<unsigned char>(info[2]) + static_cast<unsigned char>(info[3]) * 256;
-		byteCount = static_cast<unsigned char>(info[4]) / 8;
-		imageSize = textureWidth * textureHeight * byteCount;
-		imageData = new char[imageSize];
-		tgaFile.seekg(18);
-			// Read image data
-		tgaFile.read(imageData, imageSize);
-		if (!tgaFile)
+		if (static_cast<size_t>(imageID) >= m_frameCounts.size())
 		{
-			delete [] imageData;
-			return false;
+			m_frameCounts.resize(imageID + 1, 0);
+			m_frames.resize((imageID + 1) * MAX_FRAMES_PER_SPRITE);
+		}
+		m_frameCounts[imageID]++;	// keep track of how many frames per sprite we loaded
+
+		  // Cells are square and a power of two in size, like the textures OpenGL used to
+		  // scale each frame to, so mipmaps of the atlas never mix two cells
+		const size_t CELL_BYTES = ATLAS_CELL_SIZE * ATLAS_CELL_SIZE * 4;
+		size_t cell = m_cellPixels.size() / CELL_BYTES;
+		m_cellPixels.resize(m_cellPixels.size() + CELL_BYTES);
+		unsigned char* pixels = &m_cellPixels[cell * CELL_BYTES];
+		scaleToCell(image, pixels);
+
+		unsigned long long hash = 14695981039346656037ULL;	// FNV-1a
+		for (size_t k = 0; k < CELL_BYTES; k++)
+			hash = (hash ^ pixels[k]) * 1099511628211ULL;
+		for (size_t other = 0; other < cell; other++)
+		{
+			if (m_cellHashes[other] == hash && std::equal(pixels, pixels + CELL_BYTES, &m_cellPixels[other * CELL_BYTES]))
+			{
+				m_cellPixels.resize(cell * CELL_BYTES);
+				cell = other;
+				break;
+			}
 		}
+		if (cell == m_cellHashes.size())
+			m_cellHashes.push_back(hash);
+		m_frames[spriteID].cell = static_cast<int>(cell);
 
-			// image type either 2 (color) or 3 (greyscale)
-		if (type[1] != 0 || (type[2] != 2 && type[2] != 3))
-			return false;
+		return true;
+	}
 
-		if (byteCount != 3 && byteCount != 4)
+	  // Packs all loaded frames into the atlas and hands it to OpenGL
+	bool buildAtlas()
+	{
+		std::vector<unsigned char> atlas;
+		if (!packAtlas(atlas))
 			return false;
 
-		// Transfer Texture To OpenGL
-
-		glEnable(GL_DEPTH_TEST);
-	
-		  // allocate a texture handle
-		GLuint glTextureID;
-		glGenTextures( 1, &glTextureID );
-	
-		  // bind our new texture
-		glBindTexture( GL_TEXTURE_2D, glTextureID );
+		createAtlasTexture();
+		if (m_mipMapped)
+			gluBuild2DMipmaps(GL_TEXTURE_2D, 4, m_atlasWidth, m_atlasHeight, GL_BGRA, GL_UNSIGNED_BYTE, &atlas[0]);
+		else
+			glTexImage2D(GL_TEXTURE_2D, 0, 4, m_atlasWidth, m_atlasHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, &atlas[0]);
+		finishAtlas();
+		return true;
+	}
 
-		glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+	  // Packs all loaded frames into the atlas like buildAtlas(), but writes it with all
+	  // its mipmaps and where each frame is into out instead, for an asset bundle. Needs
+	  // no OpenGL, so the bundle can be written without a window.
+	bool writeAtlas(std::vector<char>& out)
+	{
+		std::vector<unsigned char> level;
+		if (!packAtlas(level))
+			return false;
 
-		if (m_mipMapped)
+		std::vector<AtlasFrameEntry> frames;
+		for (size_t spriteID = 0; spriteID < m_frames.size(); spriteID++)
 		{
-			  // when texture area is small, bilinear filter the closest mipmap
-			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-			  // when texture area is large, bilinear filter the first mipmap
-			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+			if (m_frames[spriteID].cell < 0)
+				continue;
+			AtlasFrameEntry entry;
+			entry.imageID = static_cast<unsigned int>(spriteID / MAX_FRAMES_PER_SPRITE);
+			entry.frame = static_cast<unsigned int>(spriteID % MAX_FRAMES_PER_SPRITE);
+			entry.cell = static_cast<unsigned int>(m_frames[spriteID].cell);
+			frames.push_back(entry);
 		}
-		else
+
+		AtlasHeader header;
+		std::copy(ATLAS_MAGIC, ATLAS_MAGIC + 4, header.magic);
+		header.width = m_atlasWidth;
+		header.height = m_atlasHeight;
+		header.nLevels = countMipLevels(m_atlasWidth, m_atlasHeight);
+		header.nFrames = static_cast<unsigned int>(frames.size());
+
+		out.assign(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header));
+		out.insert(out.end(), reinterpret_cast<const char*>(frames.data()), reinterpret_cast<const char*>(frames.data() + frames.size()));
+		unsigned int width = m_atlasWidth;
+		unsigned int height = m_atlasHeight;
+		for (unsigned int k = 0; k < header.nLevels; k++)
 		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			out.insert(out.end(), level.begin(), level.end());
+			if (k + 1 < header.nLevels)
+			{
+				std::vector<unsigned char> smaller;
+				halveImage(level, width, height, smaller);
+				level.swap(smaller);
+				width = std::max(1u, width / 2);
+				height = std::max(1u, height / 2);
+			}
 		}
+		finishAtlas();
+		return true;
+	}
 
-		  // Have the texture wrap both vertically and horizontally.
-		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLfloat>(GL_REPEAT));
-		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLfloat>(GL_REPEAT));
+	  // Hands an atlas written by writeAtlas() to OpenGL. Every mipmap goes straight
+	  // from data, which may point into a mapped asset bundle, and nothing is decoded,
+	  // packed or filtered.
+	bool loadAtlas(const char* data, size_t size)
+	{
+		AtlasHeader header;
+		if (size < sizeof(header))
+			return false;
+		std::memcpy(&header, data, sizeof(header));
+		if (!std::equal(ATLAS_MAGIC, ATLAS_MAGIC + 4, header.magic) ||
+			header.width % ATLAS_CELL_SIZE != 0 || header.height % ATLAS_CELL_SIZE != 0 || header.width == 0 || header.height == 0 ||
+			header.width > MAX_ATLAS_SIZE || header.height > MAX_ATLAS_SIZE ||
+			header.nLevels != countMipLevels(header.width, header.height) || header.nFrames > MAX_IMAGES * MAX_FRAMES_PER_SPRITE)
+			return false;
 
-		if (m_mipMapped)
+		  // all levels together take less than 4 / 3 of the largest
+		size_t pixelBytes = 0;
+		for (unsigned int k = 0; k < header.nLevels; k++)
+			pixelBytes += std::max(1u, header.width >> k) * std::max(1u, header.height >> k) * 4;
+		size_t framesAt = sizeof(header);
+		size_t pixelsAt = framesAt + header.nFrames * sizeof(AtlasFrameEntry);
+		if (size != pixelsAt + pixelBytes)
+			return false;
+
+		unsigned int nCells = (header.width / ATLAS_CELL_SIZE) * (header.height / ATLAS_CELL_SIZE);
+		m_frameCounts.clear();
+		m_frames.clear();
+		for (unsigned int i = 0; i < header.nFrames; i++)
 		{
-			  // build our texture mipmaps
-			  // byteCount of 3 means that BGR data is being supplied. byteCount of 4 means that BGRA data is being supplied.
-			if (3 == byteCount)
-				gluBuild2DMipmaps(GL_TEXTURE_2D, 3, textureWidth, textureHeight, GL_BGR, GL_UNSIGNED_BYTE, imageData);
-			else if (4 == byteCount)
-				gluBuild2DMipmaps(GL_TEXTURE_2D, 4, textureWidth, textureHeight, GL_BGRA, GL_UNSIGNED_BYTE, imageData);
+			AtlasFrameEntry entry;
+			std::memcpy(&entry, data + framesAt + i * sizeof(entry), sizeof(entry));
+			int spriteID = getSpriteID(entry.imageID, entry.frame);
+			if (INVALID_SPRITE_ID == spriteID || entry.cell >= nCells)
+				return false;
+			if (entry.imageID >= m_frameCounts.size())
+			{
+				m_frameCounts.resize(entry.imageID + 1, 0);
+				m_frames.resize((entry.imageID + 1) * MAX_FRAMES_PER_SPRITE);
+			}
+			m_frameCounts[entry.imageID]++;
+			m_frames[spriteID].cell = static_cast<int>(entry.cell);
 		}
-		else
+
+		m_atlasWidth = header.width;
+		m_atlasHeight = header.height;
+		createAtlasTexture();
+		const char* pixels = data + pixelsAt;
+		for (unsigned int k = 0; k < (m_mipMapped ? header.nLevels : 1); k++)
 		{
-			  // byteCount of 3 means that BGR data is being supplied. byteCount of 4 means that BGRA data is being supplied.
-			if (3 == byteCount)
-				glTexImage2D(GL_TEXTURE_2D, 0, 3, textureWidth, textureHeight, 0, GL_BGR, GL_UNSIGNED_BYTE, imageData);
-			else if (4 == byteCount)
-				glTexImage2D(GL_TEXTURE_2D, 0, 4, textureWidth, textureHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, imageData);
+			unsigned int width = std::max(1u, header.width >> k);
+			unsigned int height = std::max(1u, header.height >> k);
+			glTexImage2D(GL_TEXTURE_2D, k, 4, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+			pixels += width * height * 4;
 		}
-
-		delete [] imageData;
-
-		m_imageMap[spriteID] = glTextureID;
-
+		finishAtlas();
 		return true;
 	}
 
 	unsigned int getNumFrames(int imageID) const
 	{
-		auto it = m_frameCountPerSprite.find(imageID);
-		if (it == m_frameCountPerSprite.end())
+		if (imageID < 0 || static_cast<size_t>(imageID) >= m_frameCounts.size())
 			return 0;
 
-		return it->second;
+		return m_frameCounts[imageID];
 	}
 
 	enum Angles {
@@ -151,32 +227,19 @@ public:
 		face_left = 1, face_right = 2, face_up = 3, face_down = 4
 	};
 
-	bool plotSprite(int imageID, int frame, double gx, double gy, double gz, Angles angleDegrees)
+	  // Adds the sprite to the ones drawn by the next drawSprites(), sprites plotted
+	  // later are drawn on top of earlier ones.
+	  // scale shrinks the sprite for boards with more fields than the default board
+	bool plotSprite(int imageID, int frame, double gx, double gy, double gz, Angles angleDegrees, double scale = 1.0)
 	{
 		unsigned int spriteID = getSpriteID(imageID,frame);
-		if (INVALID_SPRITE_ID == spriteID)
-			return false;
-
-		auto it = m_imageMap.find(spriteID);
-		if (it == m_imageMap.end())
+		if (INVALID_SPRITE_ID == spriteID || spriteID >= m_frames.size() || m_frames[spriteID].cell < 0)
 			return false;
 
-		GLuint glTextureID = it->second;
-
-		glPushMatrix();
-
-		const double xoffset = SPRITE_WIDTH/2;
-		const double yoffset = SPRITE_HEIGHT/2;
-
-		glTranslatef(gx-xoffset,gy-yoffset,gz);
-		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_TEXTURE_2D);
-		glDisable(GL_DEPTH_TEST);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glBindTexture(GL_TEXTURE_2D, glTextureID);
+		const AtlasFrame& atlasFrame = m_frames[spriteID];
 
-		glColor3f (1.0, 1.0, 1.0);
+		const double xoffset = scale * SPRITE_WIDTH/2;
+		const double yoffset = scale * SPRITE_HEIGHT/2;
 
 		double cx1, cx2, cx3, cx4;
 		double cy1, cy2, cy3, cy4;
@@ -219,40 +282,107 @@ public:
 			break;
 		}
 
-		glBegin (GL_QUADS);
-		  glTexCoord2d (cx1, cy1);
-		  glVertex3f (0, 0, 0);
-		  glTexCoord2d (cx2, cy2);
-		  glVertex3f (SPRITE_WIDTH, 0, 0);
-		  glTexCoord2d (cx3, cy3);
-		  glVertex3f (SPRITE_WIDTH, SPRITE_HEIGHT, 0);
-		  glTexCoord2d (cx4, cy4);
-		  glVertex3f (0, SPRITE_HEIGHT, 0);
-		glEnd();
- 
-		glDisable(GL_TEXTURE_2D);
-		glEnable(GL_DEPTH_TEST);
+		double u0 = atlasFrame.u0;
+		double v0 = atlasFrame.v0;
+		double du = m_cellWidth;
+		double dv = m_cellHeight;
 
-		glPopAttrib();
-		glPopMatrix();
+		double x0 = gx - xoffset;
+		double y0 = gy - yoffset;
+		double x1 = x0 + scale * SPRITE_WIDTH;
+		double y1 = y0 + scale * SPRITE_HEIGHT;
+
+		addVertex(u0 + cx1 * du, v0 + cy1 * dv, x0, y0, gz);
+		addVertex(u0 + cx2 * du, v0 + cy2 * dv, x1, y0, gz);
+		addVertex(u0 + cx3 * du, v0 + cy3 * dv, x1, y1, gz);
+		addVertex(u0 + cx4 * du, v0 + cy4 * dv, x0, y1, gz);
 
 		return true;
 	}
 
+	  // Draws every sprite plotted since the last call, in one batch
+	void drawSprites()
+	{
+		if (m_vertices.empty())
+			return;
+
+		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+		glEnable(GL_TEXTURE_2D);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glBindTexture(GL_TEXTURE_2D, m_atlasTextureID);
+
+		glColor3f (1.0, 1.0, 1.0);
+
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glVertexPointer(3, GL_FLOAT, 0, &m_vertices[0]);
+		glTexCoordPointer(2, GL_FLOAT, 0, &m_texCoords[0]);
+		glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(m_vertices.size() / 3));
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+
+		glPopAttrib();
+
+		m_vertices.clear();
+		m_texCoords.clear();
+	}
+
 	~SpriteManager()
 	{
-		for (auto it = m_imageMap.begin(); it != m_imageMap.end(); it++)
-			glDeleteTextures(1, &it->second);
+		if (m_atlasTextureID != 0)
+			glDeleteTextures(1, &m_atlasTextureID);
 	}
 
 private:
+	  // Layout of an atlas written by writeAtlas(): the header, one entry per frame, then
+	  // the pixels of every mipmap from the largest to 1 x 1
+	struct AtlasHeader
+	{
+		char			magic[4];
+		unsigned int	width;
+		unsigned int	height;
+		unsigned int	nLevels;
+		unsigned int	nFrames;
+	};
+
+	struct AtlasFrameEntry
+	{
+		unsigned int	imageID;
+		unsigned int	frame;
+		unsigned int	cell;
+	};
+
+	  // Where a frame is in the atlas, the cell is -1 for frames never loaded
+	struct AtlasFrame
+	{
+		int		cell;
+		double	u0;
+		double	v0;
+
+		AtlasFrame() : cell(-1), u0(0), v0(0) {}
+	};
+
 	bool									m_mipMapped;
-	std::map<unsigned int, GLuint>			m_imageMap;
-	std::map<unsigned int, unsigned int>	m_frameCountPerSprite;
+	std::vector<unsigned int>				m_frameCounts;	// per image ID
+	std::vector<AtlasFrame>					m_frames;		// per sprite ID
+	std::vector<unsigned char>				m_cellPixels;	// frames loaded but not yet in the atlas
+	std::vector<unsigned long long>			m_cellHashes;	// of their pixels, to find frames loaded twice
+	GLuint									m_atlasTextureID;
+	unsigned int							m_atlasWidth;
+	unsigned int							m_atlasHeight;
+	double									m_cellWidth;	// size of a cell in texture coordinates
+	double									m_cellHeight;
+	std::vector<GLfloat>					m_vertices;		// 3 per vertex, 4 vertices per sprite
+	std::vector<GLfloat>					m_texCoords;	// 2 per vertex
 
 	static const int INVALID_SPRITE_ID		= -1;
 	static const int MAX_IMAGES				= 1000;
 	static const int MAX_FRAMES_PER_SPRITE	= 100;
+	static const unsigned int ATLAS_CELL_SIZE		= 128;
+	static const unsigned int ATLAS_CELLS_PER_ROW	= 8;
+	static const unsigned int MAX_ATLAS_SIZE		= 16384;
 
 	int getSpriteID(unsigned int imageID, unsigned int frame) const
 	{
@@ -261,6 +391,152 @@ private:
 
 		return imageID * MAX_FRAMES_PER_SPRITE + frame;
 	}
+
+	void addVertex(double u, double v, double x, double y, double z)
+	{
+		m_texCoords.push_back(static_cast<GLfloat>(u));
+		m_texCoords.push_back(static_cast<GLfloat>(v));
+		m_vertices.push_back(static_cast<GLfloat>(x));
+		m_vertices.push_back(static_cast<GLfloat>(y));
+		m_vertices.push_back(static_cast<GLfloat>(z));
+	}
+
+	  // Copies all loaded frames into one image, rows of cells padded to a power of two
+	bool packAtlas(std::vector<unsigned char>& atlas)
+	{
+		size_t nCells = m_cellPixels.size() / (ATLAS_CELL_SIZE * ATLAS_CELL_SIZE * 4);
+		if (nCells == 0)
+			return false;
+
+		unsigned int nRows = 1;
+		while (nRows * ATLAS_CELLS_PER_ROW < nCells)
+			nRows *= 2;
+		m_atlasWidth = ATLAS_CELLS_PER_ROW * ATLAS_CELL_SIZE;
+		m_atlasHeight = nRows * ATLAS_CELL_SIZE;
+
+		atlas.assign(m_atlasWidth * m_atlasHeight * 4, 0);
+		for (size_t cell = 0; cell < nCells; cell++)
+		{
+			unsigned int x0 = (cell % ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE;
+			unsigned int y0 = static_cast<unsigned int>(cell / ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE;
+			for (unsigned int y = 0; y < ATLAS_CELL_SIZE; y++)
+			{
+				const unsigned char* from = &m_cellPixels[((cell * ATLAS_CELL_SIZE) + y) * ATLAS_CELL_SIZE * 4];
+				std::copy(from, from + ATLAS_CELL_SIZE * 4, &atlas[((y0 + y) * m_atlasWidth + x0) * 4]);
+			}
+		}
+		return true;
+	}
+
+	  // Allocates the atlas texture and sets it up, without any pixels yet
+	void createAtlasTexture()
+	{
+		// Transfer Texture To OpenGL
+
+		glEnable(GL_DEPTH_TEST);
+
+		  // allocate a texture handle and bind it
+		if (m_atlasTextureID == 0)
+			glGenTextures( 1, &m_atlasTextureID );
+		glBindTexture( GL_TEXTURE_2D, m_atlasTextureID );
+
+		glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+
+		if (m_mipMapped)
+		{
+			  // when texture area is small, bilinear filter the closest mipmap
+			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+			  // when texture area is large, bilinear filter the first mipmap
+			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+		}
+		else
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+
+		  // Neighbouring cells must not bleed in at the edges of the atlas either
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLfloat>(GL_CLAMP));
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLfloat>(GL_CLAMP));
+	}
+
+	  // The frames are in the atlas now. Corners of each frame's cell, half a texel
+	  // inside so the filter does not pick up the neighbouring cells.
+	void finishAtlas()
+	{
+		std::vector<unsigned char>().swap(m_cellPixels);
+		std::vector<unsigned long long>().swap(m_cellHashes);
+		for (size_t k = 0; k < m_frames.size(); k++)
+		{
+			AtlasFrame& frame = m_frames[k];
+			if (frame.cell < 0)
+				continue;
+			frame.u0 = ((frame.cell % ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE + 0.5) / m_atlasWidth;
+			frame.v0 = ((frame.cell / ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE + 0.5) / m_atlasHeight;
+		}
+		m_cellWidth = (ATLAS_CELL_SIZE - 1.0) / m_atlasWidth;
+		m_cellHeight = (ATLAS_CELL_SIZE - 1.0) / m_atlasHeight;
+	}
+
+	  // Mipmaps down to 1 x 1, the largest included
+	static unsigned int countMipLevels(unsigned int width, unsigned int height)
+	{
+		unsigned int nLevels = 1;
+		for ( ; width > 1 || height > 1; nLevels++)
+		{
+			width = std::max(1u, width / 2);
+			height = std::max(1u, height / 2);
+		}
+		return nLevels;
+	}
+
+	  // The next smaller mipmap of a power of two sized image, every pixel the average of
+	  // the 2 x 2 pixels it covers, or of 2 x 1 once a side is down to 1
+	static void halveImage(const std::vector<unsigned char>& from, unsigned int width, unsigned int height,
+						   std::vector<unsigned char>& to)
+	{
+		unsigned int toWidth = std::max(1u, width / 2);
+		unsigned int toHeight = std::max(1u, height / 2);
+		unsigned int dx = width > 1 ? 1 : 0;
+		unsigned int dy = height > 1 ? 1 : 0;
+		to.resize(toWidth * toHeight * 4);
+		for (unsigned int y = 0; y < toHeight; y++)
+		{
+			for (unsigned int x = 0; x < toWidth; x++)
+			{
+				const unsigned char* p00 = &from[((y * 2) * width + x * 2) * 4];
+				const unsigned char* p01 = p00 + dx * 4;
+				const unsigned char* p10 = p00 + dy * width * 4;
+				const unsigned char* p11 = p10 + dx * 4;
+				for (int c = 0; c < 4; c++)
+					to[(y * toWidth + x) * 4 + c] = static_cast<unsigned char>((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+			}
+		}
+	}
+
+	  // Box filters the image to ATLAS_CELL_SIZE x ATLAS_CELL_SIZE, every cell pixel is
+	  // the average of the image pixels it covers
+	static void scaleToCell(const SpriteImage& image, unsigned char* cell)
+	{
+		for (unsigned int y = 0; y < ATLAS_CELL_SIZE; y++)
+		{
+			unsigned int fromY0 = y * image.height / ATLAS_CELL_SIZE;
+			unsigned int fromY1 = std::max(fromY0 + 1, (y + 1) * image.height / ATLAS_CELL_SIZE);
+			for (unsigned int x = 0; x < ATLAS_CELL_SIZE; x++)
+			{
+				unsigned int fromX0 = x * image.width / ATLAS_CELL_SIZE;
+				unsigned int fromX1 = std::max(fromX0 + 1, (x + 1) * image.width / ATLAS_CELL_SIZE);
+				unsigned int sum[4] = { 0, 0, 0, 0 };
+				for (unsigned int fy = fromY0; fy < fromY1; fy++)
+					for (unsigned int fx = fromX0; fx < fromX1; fx++)
+						for (int c = 0; c < 4; c++)
+							sum[c] += image.pixels[(fy * image.width + fx) * 4 + c];
+				unsigned int n = (fromY1 - fromY0) * (fromX1 - fromX0);
+				for (int c = 0; c < 4; c++)
+					cell[(y * ATLAS_CELL_SIZE + x) * 4 + c] = static_cast<unsigned char>((sum[c] + n / 2) / n);
+			}
+		}
+	}
 };
 
 #endif // SPRITEMANAGER_H_
@@ -1,9 +1,71 @@
 #include "StudentWorld.h"
 #include "level.h"
 #include "Actor.h"
+#include "TaskScheduler.h"
+#include "CounterRng.h"
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+	//Actors read from the level get their ids from the field they start on
+	unsigned long long getLevelActorId(int x, int y)
+	{
+		return mixHash(0x4c6576656c000000ULL ^ (static_cast<unsigned long long>(y) << 16 | static_cast<unsigned int>(x)));
+	}
+
+	//level00.dat, level01.dat, ...
+	string getLevelFileName(unsigned int levelNumber)
+	{
+		ostringstream stream;
+		stream << "level" << std::setw(2) << std::setfill('0') << levelNumber << ".dat";
+		return stream.str();
+	}
+
+	//The text in front of each number of the status line, the least number of characters the
+	//number takes and what fills them up
+	struct StatusFormat
+	{
+		const char* label;
+		size_t width;
+		char fill;
+	};
+
+	const StatusFormat STATUS_FORMATS[] = {
+		{ "Score: ", 7, '0' }, { "  Level: ", 2, '0' }, { "  Lives: ", 2, ' ' },
+		{ "  Health: ", 3, ' ' }, { "%  Ammo: ", 3, ' ' }, { "  Bonus: ", 4, ' ' }
+	};
+
+	//Characters value takes without padding, the minus sign included
+	size_t countDigits(long long value)
+	{
+		size_t n = value < 0 ? 2 : 1;
+		for (unsigned long long rest = value < 0 ? 0 - static_cast<unsigned long long>(value) : value; rest >= 10; rest /= 10)
+			n++;
+		return n;
+	}
+
+	//Writes value into the width characters at out, aligned to the right and padded with fill
+	//the same way setw and setfill pad it
+	void writeNumber(char* out, size_t width, char fill, long long value)
+	{
+		unsigned long long rest = value < 0 ? 0 - static_cast<unsigned long long>(value) : value;
+		size_t at = width;
+		do
+		{
+			out[--at] = static_cast<char>('0' + rest % 10);
+			rest /= 10;
+		} while (rest != 0);
+		if (value < 0)
+			out[--at] = '-';
+		while (at > 0)
+			out[--at] = fill;
+	}
+}
 
 GameWorld* createStudentWorld(string assetDir)
 {
@@ -24,14 +86,13 @@ int StudentWorld::init()
 	//Set data members back to inital values in case this is not the first time a level is loaded
 	m_bonus = 1000;
 	m_isLevelCompleted = false;
+	m_nTicks = 0;
+	//The two-phase tick's random streams are keyed by the generator's state when the level starts
+	m_streamSeed = getRandomState();
 
-	//load the current level
-	ostringstream stream;
-	stream << std::setw(2) << std::setfill('0') << getLevel();
-	string currentLevel = "level" + stream.str() + ".dat";
-
-	Level level(assetDirectory());
-	Level::LoadResult loadResult = level.loadLevel(currentLevel);
+	//load the current level, its file stays mapped in memory while the level runs
+	Level::LoadResult loadResult;
+	loadLevelFile(getLevel(), loadResult);
 	
 	//if there is no level left, player won, if there was an error, return that
 	if (loadResult == Level::load_fail_file_not_found)
@@ -39,193 +100,722 @@ int StudentWorld::init()
 	else if (loadResult == Level::load_fail_bad_format)
 		return GWSTATUS_LEVEL_ERROR;
 
-	//For each field in the level
-	for (int i = 0; i < VIEW_WIDTH; i++)
-	{
-		for (int j = 0; j < VIEW_HEIGHT; j++)
-		{
-			//Create the appropriate actor at this field, if any
-			switch (level.getContentsOf(i, j))
-			{
-			case Level::wall:
-				insertActor(new Wall(this, i, j));
-				break;
-			case Level::player:
-				m_player = new Player(this, i, j);
-				break;
-			case Level::boulder:
-				insertActor(new Boulder(this, i, j));
-				break;
-			case Level::hole:
-				insertActor(new Hole(this, i, j));
-				break;
-			case Level::jewel:
-				insertActor(new Jewel(this, i, j));
-				break;
-			case Level::exit:
-				insertActor(new Exit(this, i, j));
-				break;
-			case Level::extra_life:
-				insertActor(new ExtraLifeGoodie(this, i, j));
-				break;
-			case Level::restore_health:
-				insertActor(new RestoreHealthGoodie(this, i, j));
-				break;
-			case Level::ammo:
-				insertActor(new AmmoGoodie(this, i, j));
-				break; 
-			case Level::horiz_snarlbot:
-				insertActor(new SnarlBot(this, i, j, GraphObject::right));
-				break;
-			case Level::vert_snarlbot:
-				insertActor(new SnarlBot(this, i, j, GraphObject::down));
-				break;
-			case Level::kleptobot_factory:
-				insertActor(new KleptoBotFactory(this, i, j, false));
-				break;
-			case Level::angry_kleptobot_factory:
-				insertActor(new KleptoBotFactory(this, i, j, true));
-				break;
-			} 
-		}
-	}
+	//Size the world and its lists of actors per field after the level
+	resetBoard(m_level.getWidth(), m_level.getHeight());
+	int playerX, playerY;
+	setUpChunks(playerX, playerY);
+
+	//Create the player, then all the other actors in the chunks around him
+	Player* player = new Player(this, playerX, playerY);
+	player->setId(getLevelActorId(playerX, playerY));
+	player->updateHash();
+	m_player = player->getHandle();
+	updateResidentChunks();
 
 	return GWSTATUS_CONTINUE_GAME;
 }
 
 int StudentWorld::move()
 {
-	//Ask all actors to do something
-	for (list<Actor*>::iterator i = m_actors.begin(); i != m_actors.end(); i++)
+	//Make sure the actors around the player are in memory
+	updateResidentChunks();
+
+	if (getTickThreads() != 0)
 	{
-		(*i)->doSomething();
-		//If this one made the player die, handle that
-		if (!m_player->isAlive())
-		{
-			decLives();
-			return GWSTATUS_PLAYER_DIED;
-		}
-		//If this one made the user complete the level, handle that
-		if (m_isLevelCompleted)
+		int status = moveActorsInTwoPhases();
+		if (status != GWSTATUS_CONTINUE_GAME)
+			return status;
+	}
+	else
+	{
+		//Ask all actors to do something, starting at the back where the first one in tick order is
+		//Actors inserted during this loop are appended and will therefore only act in the next tick
+		for (size_t i = m_actors.size(); i-- > 0;)
 		{
-			increaseScore(2000 + m_bonus);
-			return GWSTATUS_FINISHED_LEVEL;
+			//Actors far away from the player wait until he comes closer
+			Actor* actor = getActor(m_actors[i]);
+			if (!isActingThisTick(actor))
+				continue;
+			startActing(actor);
+			actor->doSomething();
+			//If this one made the player die or complete the level, handle that
+			int status = checkLevelStatus();
+			if (status != GWSTATUS_CONTINUE_GAME)
+				return status;
 		}
 	}
 
 	//make the player do something
-	m_player->doSomething();
+	startActing(getPlayer());
+	getPlayer()->doSomething();
+
+	m_nTicks++;
 
-	//Delete all the actors that were killed during this tick
-	for (list<Actor*>::iterator j = m_actors.begin(); j != m_actors.end();)
+	//Delete all the actors that were killed during this tick and keep the others in order
+	size_t nKept = 0;
+	for (size_t j = 0; j < m_actors.size(); j++)
 	{
-		DestructableActor* da = dynamic_cast<DestructableActor*>(*j);
-		if (da != nullptr && !da->isAlive())
+		Actor* actor = getActor(m_actors[j]);
+		if (!actor->isAlive())
 		{
-			m_actors.erase(j);
-			delete da;
-			j = m_actors.begin();
+			if (dynamic_cast<Jewel*>(actor) != nullptr)
+				m_nJewels--;
+			delete actor;
 		}
 		else
-		{
-			j++;
-		}
+			m_actors[nKept++] = m_actors[j];
 	}
+	m_actors.resize(nKept);
 
 	//If bonus is above 0, decrement it by one to reflect that the user took long to finish the level
 	if (m_bonus > 0)
 		m_bonus--;
 
-	bool allJewelsCollected = true;
-
-	//Check if any jewel was not collected yet
-	for (list<Actor*>::iterator j = m_actors.begin(); j != m_actors.end(); j++)
-	{
-		Jewel* jewel = dynamic_cast<Jewel*>(*j);
-		if (jewel != nullptr)
-		{
-			allJewelsCollected = false;
-			break;
-		}
-	}
 	//if all jewels have been collected, reveal the exit
-	if (allJewelsCollected)
-		for (list<Actor*>::iterator j = m_actors.begin(); j != m_actors.end(); j++)
+	if (m_nJewels + m_nJewelsElsewhere == 0)
+		for (size_t j = 0; j < m_exits.size(); j++)
 		{
-			Exit* exit = dynamic_cast<Exit*>(*j);
-			if (exit != nullptr && !exit->isVisible())
+			Exit* exit = static_cast<Exit*>(getActor(m_exits[j]));
+			if (!exit->isVisible())
 			{
 				exit->setVisible(true);
 				playSound(SOUND_REVEAL_EXIT);
 			}
 		}
 
-	//Update the top display text
-	setDisplayText();
+	//Update the top display text, unless nobody is going to see it
+	if (!isHeadless())
+		setDisplayText();
+
+	//If this tick made the player die or complete the level, handle that, otherwise continue the game
+	return checkLevelStatus();
+}
 
-	//If this tick made the player die, handle that
-	if (!m_player->isAlive())
+int StudentWorld::checkLevelStatus()
+{
+	//If the player died, handle that
+	if (!getPlayer()->isAlive())
 	{
 		decLives();
 		return GWSTATUS_PLAYER_DIED;
 	}
-	//If this tick made the user complete the level, handle that
+	//If the user completed the level, handle that
 	if (m_isLevelCompleted)
 	{
 		increaseScore(2000 + m_bonus);
 		return GWSTATUS_FINISHED_LEVEL;
 	}
 
-	//Otherwise continue the game
+	return GWSTATUS_CONTINUE_GAME;
+}
+
+int StudentWorld::moveActorsInTwoPhases()
+{
+	//Collect the actors that act this tick in tick order
+	m_planningActors.clear();
+	for (size_t i = m_actors.size(); i-- > 0;)
+	{
+		Actor* actor = getActor(m_actors[i]);
+		if (isActingThisTick(actor))
+			m_planningActors.push_back(actor);
+	}
+	m_intents.resize(m_planningActors.size());
+
+	//Plan phase: nothing changes the world, so the batches can be planned in any order
+	size_t nActors = m_planningActors.size();
+	auto planBatch = [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			m_planningActors[i]->planTick(m_intents[i]);
+	};
+	if (getTickThreads() > 1)
+		TaskScheduler::getShared().parallelFor(0, nActors, INTENT_BATCH_SIZE, planBatch);
+	else
+		planBatch(0, nActors);
+
+	//Resolve phase: carry the intents out in tick order, every actor checks that its intent still
+	//fits the world, which may have changed through the actors before it. Actors inserted now are
+	//appended to m_actors and will therefore only act in the next tick.
+	if (m_chunks.size() > 1)
+		return resolveInRegions();
+	for (size_t i = 0; i < nActors; i++)
+	{
+		startActing(m_planningActors[i]);
+		m_planningActors[i]->resolveTick(m_intents[i]);
+		int status = checkLevelStatus();
+		if (status != GWSTATUS_CONTINUE_GAME)
+			return status;
+	}
+
 	return GWSTATUS_CONTINUE_GAME;
 }
 
 void StudentWorld::cleanUp()
 {
-	//Delete the player and the dangling pointer
-	if (m_player != nullptr)
-		delete m_player;
+	//Delete the player, deleting an actor also makes all handles to it stale
+	delete getPlayer();
 
-	m_player = nullptr;
+	m_player = ActorHandle();
 	
-	//Delete all the other dynamically allocated actors and their dangling pointers
-	for (list<Actor*>::iterator i = m_actors.begin(); i != m_actors.end(); i++)
+	//Delete all the other dynamically allocated actors
+	for (size_t i = 0; i < m_actors.size(); i++)
+	{
+		delete getActor(m_actors[i]);
+	}
+	for (size_t i = 0; i < m_staticActors.size(); i++)
 	{
-		delete *i;
+		delete getActor(m_staticActors[i]);
 	}
 
 	m_actors.clear();
+	m_staticActors.clear();
+	m_exits.clear();
+	m_nextSequence = 0;
+	m_nJewels = 0;
+
+	//The stored chunks' actors go away with them
+	for (size_t i = 0; i < m_chunks.size(); i++)
+		m_actorHash ^= m_chunks[i].hash;
+	m_chunks.clear();
+	m_nResidentChunks = 0;
+	m_nJewelsElsewhere = 0;
+}
+
+unsigned long long StudentWorld::getStateHash() const
+{
+	//The actors keep their part of the hash up to date themselves whenever they change,
+	//only the few values that belong to the world itself are mixed in here
+	unsigned long long worldState = mixHash(getScore() | static_cast<unsigned long long>(getLives()) << 32);
+	worldState = mixHash(worldState ^ (getLevel() | static_cast<unsigned long long>(m_bonus) << 32));
+	worldState = mixHash(worldState ^ (m_isLevelCompleted ? 1 : 0));
+	worldState = mixHash(worldState ^ getRandomState());
+	//Which distant chunks act and the random numbers of the two-phase tick depend on the tick,
+	//in the classic tick on single chunk boards nothing does
+	if (m_chunks.size() > 1 || getTickThreads() != 0)
+		worldState = mixHash(worldState ^ m_nTicks);
+	if (getTickThreads() != 0)
+		worldState = mixHash(worldState ^ m_streamSeed);
+	return m_actorHash ^ worldState;
+}
+
+void StudentWorld::getGraphObjectsIn(int x0, int y0, int x1, int y1, vector<GraphObject*>& objects)
+{
+	//Only the fields in the rectangle are visited, however big the board is
+	const vector<ActorSlot>& slots = m_slots;
+	auto addActors = [&objects, &slots](unsigned int first)
+	{
+		for (unsigned int slot = first; slot != NO_SLOT; slot = slots[slot].nextInCell)
+			objects.push_back(slots[slot].actor);
+	};
+	forEachCell(x0, y0, x1, y1, addActors);
+
+	//The player comes last, so it is drawn on top of everything else
+	Player* player = getPlayer();
+	if (player != nullptr && player->getX() >= x0 && player->getX() <= x1 && player->getY() >= y0 && player->getY() <= y1)
+		objects.push_back(player);
+}
+
+GraphObject* StudentWorld::getCameraTarget()
+{
+	return getPlayer();
 }
 
 list<Actor*> StudentWorld::getActorsAt(int x, int y)
 {
 	//if the player is at that field, add it to the list
 	list<Actor*> actorsFound;
-	if (m_player->getX() == x && m_player->getY() == y)
-		actorsFound.push_back(m_player);
+	Player* player = getPlayer();
+	if (player->getX() == x && player->getY() == y)
+		actorsFound.push_back(player);
 
-	//for all the other actors in the game
-	for (list<Actor*>::iterator i = m_actors.begin(); i != m_actors.end(); i++)
-	{
-		//if this actors is on the specified field, add it to the list
-		if ((*i)->getX() == x && (*i)->getY() == y)
-		{
-			actorsFound.push_back(*i);
-		}
-	}
+	//add all the other actors on that field, their list is already in tick order
+	unsigned int* cell = getCell(x, y);
+	if (cell != nullptr)
+		for (unsigned int slot = *cell; slot != NO_SLOT; slot = m_slots[slot].nextInCell)
+			actorsFound.push_back(m_slots[slot].actor);
 
 	//return the list with all the actors found
 	return actorsFound;
 }
 
 Player* StudentWorld::getPlayer() const
+{
+	return static_cast<Player*>(getActor(m_player));
+}
+
+ActorHandle StudentWorld::getPlayerHandle() const
 {
 	return m_player;
 }
 
 void StudentWorld::insertActor(Actor* actor)
 {
-	m_actors.push_front(actor);
+	//Actors read from the level or a stored chunk already have their id
+	if (actor->getId() == 0)
+		actor->setId(mixHash(m_actingId ^ mixHash(m_nTicks | static_cast<unsigned long long>(m_nChildren++) << 32)));
+	actor->updateHash();
+	addActor(actor);
+}
+
+void StudentWorld::addActor(Actor* actor)
+{
+	//New actors act first, starting with the next tick, and come first on their field
+	unsigned int slot = actor->getHandle().index;
+	m_slots[slot].sequence = m_nextSequence++;
+	linkToCell(slot, actor->getX(), actor->getY());
+
+	if (actor->isStatic())
+		m_staticActors.push_back(actor->getHandle());
+	else
+		m_actors.push_back(actor->getHandle());
+
+	if (dynamic_cast<Jewel*>(actor) != nullptr)
+		m_nJewels++;
+	else if (dynamic_cast<Exit*>(actor) != nullptr)
+		m_exits.push_back(actor->getHandle());
+}
+
+void StudentWorld::resetBoard(int width, int height)
+{
+	setBoardSize(width, height);
+	m_grid.reset(width, height);
+	backgroundChanged();
+}
+
+int StudentWorld::countKleptoBotsNear(int x, int y, int radius) const
+{
+	//Walk the fields of the square directly instead of building a list of actors for each one,
+	//and tell KleptoBots by their image instead of casting every wall in the square
+	int count = 0;
+	const vector<ActorSlot>& slots = m_slots;
+	auto countBots = [&count, &slots](unsigned int first)
+	{
+		for (unsigned int slot = first; slot != NO_SLOT; slot = slots[slot].nextInCell)
+		{
+			unsigned int imageID = slots[slot].actor->getID();
+			if (imageID == IID_KLEPTOBOT || imageID == IID_ANGRY_KLEPTOBOT)
+				count++;
+		}
+	};
+	forEachCell(x - radius, y - radius, x + radius, y + radius, countBots);
+	return count;
+}
+
+namespace
+{
+	//Where the intents of the region the current thread resolves collect their hash changes
+	THREAD_LOCAL unsigned long long* t_regionHash = nullptr;
+}
+
+int StudentWorld::resolveInRegions()
+{
+	//Every chunk is a region. Local intents well inside their chunk cannot interfere with any
+	//other chunk, so each chunk's are carried out in tick order by one thread. Which intents
+	//those are only depends on the board, never on the number of threads.
+	m_regionIntents.resize(m_chunks.size());
+	m_handedOffIntents.clear();
+	vector<int> regions;
+	for (size_t i = 0; i < m_planningActors.size(); i++)
+	{
+		const Actor* actor = m_planningActors[i];
+		const Intent& intent = m_intents[i];
+		int region = (actor->getY() / CHUNK_SIZE) * m_nChunksX + actor->getX() / CHUNK_SIZE;
+		if (intent.isLocal && isInRegionInterior(actor->getX(), actor->getY(), region) &&
+			(intent.type != Intent::move || isInRegionInterior(intent.x, intent.y, region)))
+		{
+			if (m_regionIntents[region].empty())
+				regions.push_back(region);
+			m_regionIntents[region].push_back(i);
+		}
+		else
+			m_handedOffIntents.push_back(i);
+	}
+
+	//The state hash is the only thing all of them change, XORing every region's changes into it
+	//afterwards gives the same hash in any order
+	m_regionHashes.assign(regions.size(), 0);
+	m_isResolvingRegions = true;
+	auto resolveRegions = [this, &regions](size_t begin, size_t end)
+	{
+		for (size_t k = begin; k < end; k++)
+		{
+			t_regionHash = &m_regionHashes[k];
+			const vector<size_t>& indices = m_regionIntents[regions[k]];
+			for (size_t j = 0; j < indices.size(); j++)
+				m_planningActors[indices[j]]->resolveTick(m_intents[indices[j]]);
+			t_regionHash = nullptr;
+		}
+	};
+	if (getTickThreads() > 1)
+		TaskScheduler::getShared().parallelFor(0, regions.size(), 1, resolveRegions);
+	else
+		resolveRegions(0, regions.size());
+	m_isResolvingRegions = false;
+	for (size_t k = 0; k < regions.size(); k++)
+	{
+		m_actorHash ^= m_regionHashes[k];
+		m_regionIntents[regions[k]].clear();
+	}
+
+	//Hand-off: everything near a border or reaching beyond the actor itself follows in tick order
+	for (size_t j = 0; j < m_handedOffIntents.size(); j++)
+	{
+		size_t i = m_handedOffIntents[j];
+		startActing(m_planningActors[i]);
+		m_planningActors[i]->resolveTick(m_intents[i]);
+		int status = checkLevelStatus();
+		if (status != GWSTATUS_CONTINUE_GAME)
+			return status;
+	}
+
+	return GWSTATUS_CONTINUE_GAME;
+}
+
+bool StudentWorld::isInRegionInterior(int x, int y, int region) const
+{
+	int dx = x - (region % m_nChunksX) * CHUNK_SIZE;
+	int dy = y - (region / m_nChunksX) * CHUNK_SIZE;
+	return dx >= REGION_HALO && dx < CHUNK_SIZE - REGION_HALO && dy >= REGION_HALO && dy < CHUNK_SIZE - REGION_HALO;
+}
+
+void StudentWorld::toggleRegionHash(unsigned long long key)
+{
+	*t_regionHash ^= key;
+}
+
+int StudentWorld::randIntFor(const Actor* actor, int drawIndex, int limit) const
+{
+	return counterRandInt(m_streamSeed, m_nTicks, actor->getId(), static_cast<unsigned int>(drawIndex), limit);
+}
+
+void StudentWorld::startActing(const Actor* actor)
+{
+	//Everything the actor creates now gets an id derived from its own
+	m_actingId = actor->getId();
+	m_nChildren = 0;
+}
+
+void StudentWorld::actorMoved(Actor* actor, int oldX, int oldY)
+{
+	unsigned int slot = actor->getHandle().index;
+	if (!m_slots[slot].isInCell || (actor->getX() == oldX && actor->getY() == oldY))
+		return;
+	unlinkFromCell(slot, oldX, oldY);
+	linkToCell(slot, actor->getX(), actor->getY());
+}
+
+void StudentWorld::linkToCell(unsigned int slot, int x, int y)
+{
+	unsigned int* next = getCell(x, y);
+	if (next == nullptr)
+		return;
+
+	//Keep the list sorted from the newest to the oldest actor
+	while (*next != NO_SLOT && m_slots[*next].sequence > m_slots[slot].sequence)
+		next = &m_slots[*next].nextInCell;
+	m_slots[slot].nextInCell = *next;
+	m_slots[slot].isInCell = true;
+	*next = slot;
+}
+
+void StudentWorld::unlinkFromCell(unsigned int slot, int x, int y)
+{
+	unsigned int* next = getCell(x, y);
+	while (next != nullptr && *next != NO_SLOT)
+	{
+		if (*next == slot)
+		{
+			*next = m_slots[slot].nextInCell;
+			break;
+		}
+		next = &m_slots[*next].nextInCell;
+	}
+	m_slots[slot].nextInCell = NO_SLOT;
+	m_slots[slot].isInCell = false;
+}
+
+ActorHandle StudentWorld::registerActor(Actor* actor)
+{
+	//While a snapshot is restored, the actor gets back exactly the handle it had before
+	if (m_restoredHandle.isValid())
+	{
+		ActorSlot& slot = m_slots[m_restoredHandle.index];
+		slot.actor = actor;
+		slot.generation = m_restoredHandle.generation;
+		slot.isInCell = false;
+		return m_restoredHandle;
+	}
+
+	//Reuse a free slot if there is one, otherwise grow the table
+	unsigned int index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = static_cast<unsigned int>(m_slots.size());
+		ActorSlot slot = { nullptr, 1, NO_SLOT, 0, false };
+		m_slots.push_back(slot);
+	}
+
+	m_slots[index].actor = actor;
+	return ActorHandle(index, m_slots[index].generation);
+}
+
+void StudentWorld::unregisterActor(ActorHandle handle)
+{
+	if (getActor(handle) == nullptr)
+		return;
+
+	//Take the actor off its field, free the slot and advance its generation, so every handle to it
+	//becomes stale
+	ActorSlot& slot = m_slots[handle.index];
+	if (slot.isInCell)
+		unlinkFromCell(handle.index, slot.actor->getX(), slot.actor->getY());
+	slot.actor = nullptr;
+	slot.generation++;
+	if (slot.generation == 0)
+		slot.generation = 1;
+	m_freeSlots.push_back(handle.index);
+}
+
+bool StudentWorld::loadLevelFile(unsigned int levelNumber, Level::LoadResult& result)
+{
+	//Dying does not load the level file again, it is still mapped
+	if (m_levelLoaded == static_cast<int>(levelNumber))
+	{
+		result = Level::load_success;
+		return true;
+	}
+
+	result = m_level.loadLevel(getLevelFileName(levelNumber));
+	m_levelLoaded = (result == Level::load_success) ? static_cast<int>(levelNumber) : -1;
+	return result == Level::load_success;
+}
+
+Actor* StudentWorld::createActor(Level::MazeEntry entry, int x, int y)
+{
+	//Create the appropriate actor for this field of the level, if any, the player is created by init
+	switch (entry)
+	{
+	case Level::wall:
+		return new Wall(this, x, y);
+	case Level::boulder:
+		return new Boulder(this, x, y);
+	case Level::hole:
+		return new Hole(this, x, y);
+	case Level::jewel:
+		return new Jewel(this, x, y);
+	case Level::exit:
+		return new Exit(this, x, y);
+	case Level::extra_life:
+		return new ExtraLifeGoodie(this, x, y);
+	case Level::restore_health:
+		return new RestoreHealthGoodie(this, x, y);
+	case Level::ammo:
+		return new AmmoGoodie(this, x, y);
+	case Level::horiz_snarlbot:
+		return new SnarlBot(this, x, y, GraphObject::right);
+	case Level::vert_snarlbot:
+		return new SnarlBot(this, x, y, GraphObject::down);
+	case Level::kleptobot_factory:
+		return new KleptoBotFactory(this, x, y, false);
+	case Level::angry_kleptobot_factory:
+		return new KleptoBotFactory(this, x, y, true);
+	default:
+		return nullptr;
+	}
+}
+
+void StudentWorld::setUpChunks(int& playerX, int& playerY)
+{
+	m_nChunksX = (m_level.getWidth() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_nChunksY = (m_level.getHeight() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_chunks.assign(static_cast<size_t>(m_nChunksX) * m_nChunksY, Chunk());
+	m_nResidentChunks = 0;
+	m_nJewelsElsewhere = 0;
+
+	//No chunk is resident yet, but the exit may only appear once the jewels of all of them are gone
+	playerX = playerY = 0;
+	for (int x = 0; x < m_level.getWidth(); x++)
+	{
+		for (int y = 0; y < m_level.getHeight(); y++)
+		{
+			Level::MazeEntry entry = m_level.getContentsOf(x, y);
+			if (entry == Level::jewel)
+			{
+				m_chunks[(y / CHUNK_SIZE) * m_nChunksX + x / CHUNK_SIZE].nJewels++;
+				m_nJewelsElsewhere++;
+			}
+			else if (entry == Level::player)
+			{
+				playerX = x;
+				playerY = y;
+			}
+		}
+	}
+}
+
+void StudentWorld::updateResidentChunks()
+{
+	Player* player = getPlayer();
+	m_centerChunkX = player->getX() / CHUNK_SIZE;
+	m_centerChunkY = player->getY() / CHUNK_SIZE;
+
+	//The chunks that act are surrounded by one more ring of resident ones, so whatever acts can
+	//always see the actors on every field it can reach in one tick
+	const int radius = COARSE_CHUNK_RADIUS + 1;
+	bool loadedAny = false;
+	for (int cy = max(m_centerChunkY - radius, 0); cy <= min(m_centerChunkY + radius, m_nChunksY - 1); cy++)
+	{
+		for (int cx = max(m_centerChunkX - radius, 0); cx <= min(m_centerChunkX + radius, m_nChunksX - 1); cx++)
+		{
+			if (m_chunks[cy * m_nChunksX + cx].state != Chunk::resident)
+			{
+				loadChunk(cx, cy);
+				loadedAny = true;
+			}
+		}
+	}
+
+	unsigned int limit = getResidentChunkLimit() != 0 ? getResidentChunkLimit() : DEFAULT_RESIDENT_CHUNKS;
+	limit = max(limit, static_cast<unsigned int>((2 * radius + 1) * (2 * radius + 1)));
+	if (!loadedAny || m_nResidentChunks <= limit)
+		return;
+
+	//Evict the resident chunks farthest from the player until the rest fits into the limit
+	vector<pair<int, int> > candidates;
+	for (int cy = 0; cy < m_nChunksY; cy++)
+	{
+		for (int cx = 0; cx < m_nChunksX; cx++)
+		{
+			int distance = max(abs(cx - m_centerChunkX), abs(cy - m_centerChunkY));
+			if (distance > radius && m_chunks[cy * m_nChunksX + cx].state == Chunk::resident)
+				candidates.push_back(make_pair(-distance, cy * m_nChunksX + cx));
+		}
+	}
+	sort(candidates.begin(), candidates.end());
+	for (size_t i = 0; i < candidates.size() && m_nResidentChunks > limit; i++)
+		evictChunk(candidates[i].second % m_nChunksX, candidates[i].second / m_nChunksX);
+
+	//The evicted actors' handles are stale now
+	StudentWorld* world = this;
+	auto isStale = [world](ActorHandle handle) { return world->getActor(handle) == nullptr; };
+	m_actors.erase(remove_if(m_actors.begin(), m_actors.end(), isStale), m_actors.end());
+	m_staticActors.erase(remove_if(m_staticActors.begin(), m_staticActors.end(), isStale), m_staticActors.end());
+	m_exits.erase(remove_if(m_exits.begin(), m_exits.end(), isStale), m_exits.end());
+}
+
+void StudentWorld::loadChunk(int chunkX, int chunkY)
+{
+	Chunk& chunk = m_chunks[chunkY * m_nChunksX + chunkX];
+	if (chunk.state == Chunk::unloaded)
+	{
+		//Read the fields in the same order the whole level was always read in, column by column
+		int x1 = min((chunkX + 1) * CHUNK_SIZE, m_level.getWidth());
+		int y1 = min((chunkY + 1) * CHUNK_SIZE, m_level.getHeight());
+		for (int x = chunkX * CHUNK_SIZE; x < x1; x++)
+		{
+			for (int y = chunkY * CHUNK_SIZE; y < y1; y++)
+			{
+				Actor* actor = createActor(m_level.getContentsOf(x, y), x, y);
+				if (actor != nullptr)
+				{
+					actor->setId(getLevelActorId(x, y));
+					insertActor(actor);
+				}
+			}
+		}
+	}
+	else
+	{
+		//The stored actors' part of the hash stayed in it, they add it again themselves
+		m_actorHash ^= chunk.hash;
+
+		//Recreating a KleptoBot must not draw from the world's random numbers
+		unsigned long long randomState = getRandomState();
+		const ActorState* states = reinterpret_cast<const ActorState*>(chunk.actors.data());
+		size_t nStates = chunk.actors.size() / sizeof(ActorState);
+		for (size_t i = 0; i < nStates; i++)
+		{
+			Actor* actor = createActor(states[i], false);
+			actor->loadState(states[i]);
+			insertActor(actor);
+		}
+		setRandomSeed(randomState);
+		vector<char>().swap(chunk.actors);
+	}
+
+	m_nJewelsElsewhere -= chunk.nJewels;
+	chunk.nJewels = 0;
+	chunk.hash = 0;
+	chunk.state = Chunk::resident;
+	m_nResidentChunks++;
+	backgroundChanged();
+}
+
+void StudentWorld::evictChunk(int chunkX, int chunkY)
+{
+	Chunk& chunk = m_chunks[chunkY * m_nChunksX + chunkX];
+
+	//Collect the chunk's actors from the oldest to the newest, so they are added back in tick order
+	vector<unsigned int> slots;
+	const vector<ActorSlot>& allSlots = m_slots;
+	forEachCell(chunkX * CHUNK_SIZE, chunkY * CHUNK_SIZE, (chunkX + 1) * CHUNK_SIZE - 1, (chunkY + 1) * CHUNK_SIZE - 1,
+		[&slots, &allSlots](unsigned int first)
+		{
+			for (unsigned int slot = first; slot != NO_SLOT; slot = allSlots[slot].nextInCell)
+				slots.push_back(slot);
+		});
+	sort(slots.begin(), slots.end(), [&allSlots](unsigned int a, unsigned int b)
+		{
+			return allSlots[a].sequence < allSlots[b].sequence;
+		});
+
+	//Evicting happens right after the dead actors of the last tick were deleted, so all are kept
+	chunk.actors.resize(slots.size() * sizeof(ActorState));
+	ActorState* states = reinterpret_cast<ActorState*>(chunk.actors.data());
+	unsigned long long hashBefore = m_actorHash;
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		Actor* actor = m_slots[slots[i]].actor;
+		actor->saveState(states[i]);
+		if (dynamic_cast<Jewel*>(actor) != nullptr)
+		{
+			m_nJewels--;
+			chunk.nJewels++;
+		}
+		delete actor;
+	}
+
+	//Their part of the hash stays in it while they are stored, as if they were still there
+	chunk.hash = hashBefore ^ m_actorHash;
+	m_actorHash = hashBefore;
+	m_nJewelsElsewhere += chunk.nJewels;
+	chunk.state = Chunk::stored;
+	m_nResidentChunks--;
+	backgroundChanged();
+}
+
+bool StudentWorld::isActingThisTick(const Actor* actor) const
+{
+	if (m_chunks.size() <= 1)
+		return true;
+
+	int chunkX = actor->getX() / CHUNK_SIZE;
+	int chunkY = actor->getY() / CHUNK_SIZE;
+	int distance = max(abs(chunkX - m_centerChunkX), abs(chunkY - m_centerChunkY));
+	if (distance <= ACTIVE_CHUNK_RADIUS)
+		return true;
+	if (distance > COARSE_CHUNK_RADIUS)
+		return false;
+
+	//Neighbouring chunks take turns, so every tick does about the same amount of work. This only
+	//depends on the tick and the player's position, so the chunks the player approaches are back
+	//to acting every tick exactly when they come within ACTIVE_CHUNK_RADIUS.
+	return (m_nTicks + chunkX + chunkY) % COARSE_TICK_INTERVAL == 0;
 }
 
 void StudentWorld::setLevelCompleted()
@@ -233,32 +823,400 @@ void StudentWorld::setLevelCompleted()
 	m_isLevelCompleted = true;
 }
 
-void StudentWorld::setDisplayText()
+namespace
+{
+	//Header of a snapshot blob, followed by the generation of every actor slot, the list of
+	//free slots, one ActorState per actor, the player first, then the static actors, then the
+	//others in m_actors order, and finally a ChunkRecord per chunk with its stored actors
+	struct SnapshotHeader
+	{
+		unsigned int		magic;
+		unsigned int		boardWidth;
+		unsigned int		boardHeight;
+		unsigned int		lives;
+		unsigned int		score;
+		unsigned int		level;
+		int					bonus;
+		unsigned int		isLevelCompleted;
+		unsigned int		nTicks;
+		unsigned int		unused;
+		unsigned long long	randomState;
+		unsigned long long	streamSeed;
+		unsigned int		nSlots;
+		unsigned int		nFreeSlots;
+		unsigned int		nActors;
+	};
+
+	struct ChunkRecord
+	{
+		unsigned int		state;
+		int					nJewels;
+		unsigned long long	hash;
+		unsigned int		nActors;
+		unsigned int		unused;
+	};
+
+	const unsigned int SNAPSHOT_MAGIC = 0x35534242;	//"BBS5"
+
+	//Whether createActor can bring the actor back, on a field from x0, y0 up to but not including
+	//x1, y1
+	bool isRestorableState(const ActorState& state, int x0, int y0, int x1, int y1)
+	{
+		return state.imageID >= IID_PLAYER && state.imageID <= IID_AMMO &&
+			state.x >= x0 && state.x < x1 && state.y >= y0 && state.y < y1;
+	}
+}
+
+void StudentWorld::snapshot(vector<char>& blob) const
+{
+	size_t nActors = 1 + m_staticActors.size() + m_actors.size();
+	size_t size = sizeof(SnapshotHeader) + (m_slots.size() + m_freeSlots.size()) * sizeof(unsigned int) +
+		nActors * sizeof(ActorState) + m_chunks.size() * sizeof(ChunkRecord);
+	for (size_t i = 0; i < m_chunks.size(); i++)
+		size += m_chunks[i].actors.size();
+	//Zeroed, so the padding inside the records is the same in every snapshot of the same world
+	blob.assign(size, 0);
+	char* out = &blob[0];
+
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.boardWidth = getBoardWidth();
+	header.boardHeight = getBoardHeight();
+	header.lives = getLives();
+	header.score = getScore();
+	header.level = getLevel();
+	header.bonus = m_bonus;
+	header.isLevelCompleted = m_isLevelCompleted ? 1 : 0;
+	header.nTicks = m_nTicks;
+	header.unused = 0;
+	header.randomState = getRandomState();
+	header.streamSeed = m_streamSeed;
+	header.nSlots = static_cast<unsigned int>(m_slots.size());
+	header.nFreeSlots = static_cast<unsigned int>(m_freeSlots.size());
+	header.nActors = static_cast<unsigned int>(nActors);
+	memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+
+	//Store the generations, so handles stay valid or stale across a restore exactly as they were
+	for (size_t i = 0; i < m_slots.size(); i++, out += sizeof(unsigned int))
+		memcpy(out, &m_slots[i].generation, sizeof(unsigned int));
+	if (!m_freeSlots.empty())
+	{
+		memcpy(out, &m_freeSlots[0], m_freeSlots.size() * sizeof(unsigned int));
+		out += m_freeSlots.size() * sizeof(unsigned int);
+	}
+
+	//Let every actor write its own state. The records are only 4 byte aligned after an odd number
+	//of slots, so each one is written into a local first and copied into the blob.
+	ActorState state;
+	memset(&state, 0, sizeof(state));
+	getActor(m_player)->saveState(state);
+	memcpy(out, &state, sizeof(state));
+	out += sizeof(state);
+	for (size_t i = 0; i < m_staticActors.size(); i++, out += sizeof(state))
+	{
+		getActor(m_staticActors[i])->saveState(state);
+		memcpy(out, &state, sizeof(state));
+	}
+	for (size_t i = 0; i < m_actors.size(); i++, out += sizeof(state))
+	{
+		getActor(m_actors[i])->saveState(state);
+		memcpy(out, &state, sizeof(state));
+	}
+
+	//Chunks that were never resident are restored from the level file
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		const Chunk& chunk = m_chunks[i];
+		ChunkRecord record;
+		record.state = chunk.state;
+		record.nJewels = chunk.nJewels;
+		record.hash = chunk.hash;
+		record.nActors = static_cast<unsigned int>(chunk.actors.size() / sizeof(ActorState));
+		record.unused = 0;
+		memcpy(out, &record, sizeof(record));
+		out += sizeof(record);
+		if (!chunk.actors.empty())
+		{
+			memcpy(out, chunk.actors.data(), chunk.actors.size());
+			out += chunk.actors.size();
+		}
+	}
+}
+
+bool StudentWorld::restore(const vector<char>& blob)
+{
+	//Read and check the whole blob before anything of the world is touched, so a blob that is
+	//rejected leaves the world exactly as it was
+	const char* in = blob.data();
+	const char* end = blob.data() + blob.size();
+	SnapshotHeader header;
+	if (blob.size() < sizeof(header))
+		return false;
+	memcpy(&header, in, sizeof(header));
+	in += sizeof(header);
+	if (header.magic != SNAPSHOT_MAGIC || header.nActors == 0 || header.nFreeSlots > header.nSlots ||
+		header.boardWidth == 0 || header.boardWidth > Level::MAX_SIZE ||
+		header.boardHeight == 0 || header.boardHeight > Level::MAX_SIZE ||
+		header.nSlots > static_cast<size_t>(end - in) / sizeof(unsigned int) / 2)
+		return false;
+
+	vector<unsigned int> generations(header.nSlots);
+	if (!generations.empty())
+		memcpy(&generations[0], in, generations.size() * sizeof(unsigned int));
+	in += generations.size() * sizeof(unsigned int);
+	vector<unsigned int> freeSlots(header.nFreeSlots);
+	if (!freeSlots.empty())
+		memcpy(&freeSlots[0], in, freeSlots.size() * sizeof(unsigned int));
+	in += freeSlots.size() * sizeof(unsigned int);
+
+	//Every slot holds at most one actor or is free
+	vector<char> isSlotUsed(header.nSlots, 0);
+	for (size_t i = 0; i < freeSlots.size(); i++)
+	{
+		if (freeSlots[i] >= header.nSlots || isSlotUsed[freeSlots[i]])
+			return false;
+		isSlotUsed[freeSlots[i]] = 1;
+	}
+
+	//The player comes first, every actor gets back the handle it had
+	if (header.nActors > static_cast<size_t>(end - in) / sizeof(ActorState))
+		return false;
+	vector<ActorState> states(header.nActors);
+	memcpy(&states[0], in, states.size() * sizeof(ActorState));
+	in += states.size() * sizeof(ActorState);
+	for (unsigned int i = 0; i < header.nActors; i++)
+	{
+		const ActorState& state = states[i];
+		if (!isRestorableState(state, 0, 0, header.boardWidth, header.boardHeight) ||
+			(state.imageID == IID_PLAYER) != (i == 0) ||
+			state.handleIndex >= header.nSlots || isSlotUsed[state.handleIndex] ||
+			state.handleGeneration == 0 || state.handleGeneration != generations[state.handleIndex])
+			return false;
+		isSlotUsed[state.handleIndex] = 1;
+	}
+
+	//Only stored chunks keep actors, each of them on a field of its own chunk
+	int nChunksX = (header.boardWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	int nChunksY = (header.boardHeight + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	vector<ChunkRecord> chunkRecords(static_cast<size_t>(nChunksX) * nChunksY);
+	vector<const char*> chunkActors(chunkRecords.size());
+	for (size_t i = 0; i < chunkRecords.size(); i++)
+	{
+		ChunkRecord& record = chunkRecords[i];
+		if (static_cast<size_t>(end - in) < sizeof(record))
+			return false;
+		memcpy(&record, in, sizeof(record));
+		in += sizeof(record);
+		if (record.state > Chunk::stored || (record.state != Chunk::stored && record.nActors != 0) ||
+			record.nActors > static_cast<size_t>(end - in) / sizeof(ActorState))
+			return false;
+
+		chunkActors[i] = in;
+		int x0 = static_cast<int>(i % nChunksX) * CHUNK_SIZE;
+		int y0 = static_cast<int>(i / nChunksX) * CHUNK_SIZE;
+		for (unsigned int k = 0; k < record.nActors; k++, in += sizeof(ActorState))
+		{
+			ActorState state;
+			memcpy(&state, in, sizeof(state));
+			if (!isRestorableState(state, x0, y0, min<int>(x0 + CHUNK_SIZE, header.boardWidth), min<int>(y0 + CHUNK_SIZE, header.boardHeight)) ||
+				state.imageID == IID_PLAYER)
+				return false;
+		}
+	}
+	if (in != end)
+		return false;
+
+	//The chunks that were never resident still need the level file. Another level than the current
+	//one is read into a Level of its own, which only replaces the current one once all is well.
+	Level level(assetDirectory());
+	bool isOtherLevel = m_levelLoaded != static_cast<int>(header.level);
+	if (isOtherLevel && level.loadLevel(getLevelFileName(header.level)) != Level::load_success)
+		return false;
+	const Level& restoredLevel = isOtherLevel ? level : m_level;
+	if (restoredLevel.getWidth() != static_cast<int>(header.boardWidth) ||
+		restoredLevel.getHeight() != static_cast<int>(header.boardHeight))
+		return false;
+
+	//Everything checked out: throw away the current level and bring back the values of the world
+	//itself first, since robots depend on the level number when they are created
+	cleanUp();
+	if (isOtherLevel)
+	{
+		m_level.swap(level);
+		m_levelLoaded = static_cast<int>(header.level);
+	}
+	restoreProgress(header.lives, header.score, header.level);
+	m_bonus = header.bonus;
+	m_isLevelCompleted = header.isLevelCompleted != 0;
+	m_nTicks = header.nTicks;
+	m_streamSeed = header.streamSeed;
+	resetBoard(header.boardWidth, header.boardHeight);
+
+	m_slots.resize(header.nSlots);
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		m_slots[i].actor = nullptr;
+		m_slots[i].nextInCell = NO_SLOT;
+		m_slots[i].isInCell = false;
+		m_slots[i].generation = generations[i];
+	}
+	m_freeSlots.swap(freeSlots);
+
+	//Recreate every actor in its old slot, adding them in the stored order puts them back into
+	//the same order on their fields
+	for (unsigned int i = 0; i < header.nActors; i++)
+	{
+		Actor* actor = createActor(states[i], true);
+		actor->loadState(states[i]);
+		actor->updateHash();
+		if (i == 0)
+			m_player = actor->getHandle();
+		else
+			addActor(actor);
+	}
+
+	m_nChunksX = nChunksX;
+	m_nChunksY = nChunksY;
+	m_chunks.assign(chunkRecords.size(), Chunk());
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		const ChunkRecord& record = chunkRecords[i];
+		Chunk& chunk = m_chunks[i];
+		chunk.state = static_cast<Chunk::State>(record.state);
+		chunk.nJewels = record.nJewels;
+		chunk.hash = record.hash;
+		chunk.actors.assign(chunkActors[i], chunkActors[i] + record.nActors * sizeof(ActorState));
+		if (chunk.state == Chunk::resident)
+			m_nResidentChunks++;
+		else
+			m_nJewelsElsewhere += chunk.nJewels;
+		m_actorHash ^= chunk.hash;
+	}
+	m_centerChunkX = getPlayer()->getX() / CHUNK_SIZE;
+	m_centerChunkY = getPlayer()->getY() / CHUNK_SIZE;
+
+	//Only now, since creating a KleptoBot draws a random number
+	setRandomSeed(header.randomState);
+
+	return true;
+}
+
+Actor* StudentWorld::createActor(const ActorState& state, bool keepHandle)
 {
-	//Format all the numbers for the display properly with an ostringstream
-	ostringstream scoreStream;
-	scoreStream << setw(7) << setfill('0') << getScore();
+	//Make registerActor hand out the stored handle instead of a new one
+	if (keepHandle)
+	{
+		if (state.handleIndex >= m_slots.size())
+			return nullptr;
+		m_restoredHandle = ActorHandle(state.handleIndex, state.handleGeneration);
+	}
 
-	ostringstream lvlStream;
-	lvlStream << setw(2) << setfill('0') << getLevel();
+	Actor* actor = nullptr;
+	int x = state.x, y = state.y;
+	switch (state.imageID)
+	{
+	case IID_PLAYER:
+		actor = new Player(this, x, y);
+		break;
+	case IID_SNARLBOT:
+		actor = new SnarlBot(this, x, y, static_cast<GraphObject::Direction>(state.direction));
+		break;
+	case IID_KLEPTOBOT:
+		actor = new KleptoBot(this, x, y);
+		break;
+	case IID_ANGRY_KLEPTOBOT:
+		actor = new AngryKleptoBot(this, x, y);
+		break;
+	case IID_ROBOT_FACTORY:
+		actor = new KleptoBotFactory(this, x, y, state.typeState[0] != 0);
+		break;
+	case IID_BULLET:
+		actor = new Bullet(this, x, y, static_cast<GraphObject::Direction>(state.direction));
+		break;
+	case IID_WALL:
+		actor = new Wall(this, x, y);
+		break;
+	case IID_EXIT:
+		actor = new Exit(this, x, y);
+		break;
+	case IID_BOULDER:
+		actor = new Boulder(this, x, y);
+		break;
+	case IID_HOLE:
+		actor = new Hole(this, x, y);
+		break;
+	case IID_JEWEL:
+		actor = new Jewel(this, x, y);
+		break;
+	case IID_RESTORE_HEALTH:
+		actor = new RestoreHealthGoodie(this, x, y);
+		break;
+	case IID_EXTRA_LIFE:
+		actor = new ExtraLifeGoodie(this, x, y);
+		break;
+	case IID_AMMO:
+		actor = new AmmoGoodie(this, x, y);
+		break;
+	}
 
-	ostringstream livesStream;
-	livesStream << setw(2) << setfill(' ') << getLives();
+	m_restoredHandle = ActorHandle();
+	return actor;
+}
 
-	ostringstream hpStream;
-	hpStream << setw(3) << setfill(' ') << (m_player->getHp() * (100 / 20));
+const string& StudentWorld::getGameStatText() const
+{
+	//The controller reads the line from here, so it is not copied whenever it changes
+	return m_statusText;
+}
 
-	ostringstream ammoStream;
-	ammoStream << setw(3) << setfill(' ') << m_player->getAmmunition();
+void StudentWorld::setDisplayText()
+{
+	long long values[nStatusFields] = { getScore(), getLevel(), getLives(), getPlayer()->getHp() * (100 / 20),
+		getPlayer()->getAmmunition(), m_bonus };
 
-	ostringstream bonusStream;
-	bonusStream << setw(4) << setfill(' ') << m_bonus;
+	//Usually only the bonus changed. A number that needs a different width moves everything after
+	//it, then the whole line is laid out again.
+	bool hasChanged = !m_hasStatusText;
+	bool keepsLayout = m_hasStatusText;
+	for (int i = 0; i < nStatusFields && keepsLayout; i++)
+	{
+		if (values[i] != m_statusValues[i])
+		{
+			hasChanged = true;
+			keepsLayout = max(STATUS_FORMATS[i].width, countDigits(values[i])) == m_statusWidths[i];
+		}
+	}
+	if (!hasChanged)
+		return;
 
-	//Put all the formatted numbers together with the appropriate explanatory text into the string
-	string statusText = "Score: " + scoreStream.str() + "  Level: " + lvlStream.str() +
-		"  Lives: " + livesStream.str() + "  Health: " + hpStream.str() + "%  Ammo: " + 
-		ammoStream.str() + "  Bonus: " + bonusStream.str();
+	if (!keepsLayout)
+		layOutStatusText(values);
+	else
+	{
+		for (int i = 0; i < nStatusFields; i++)
+		{
+			if (values[i] != m_statusValues[i])
+			{
+				writeNumber(&m_statusText[m_statusPositions[i]], m_statusWidths[i], STATUS_FORMATS[i].fill, values[i]);
+				m_statusValues[i] = values[i];
+			}
+		}
+	}
+}
 
-	//Update the top text above the game world
-	setGameStatText(statusText);
+void StudentWorld::layOutStatusText(const long long values[nStatusFields])
+{
+	m_statusText.clear();
+	for (int i = 0; i < nStatusFields; i++)
+	{
+		m_statusText += STATUS_FORMATS[i].label;
+		m_statusPositions[i] = m_statusText.size();
+		m_statusWidths[i] = max(STATUS_FORMATS[i].width, countDigits(values[i]));
+		m_statusText.append(m_statusWidths[i], ' ');
+		writeNumber(&m_statusText[m_statusPositions[i]], m_statusWidths[i], STATUS_FORMATS[i].fill, values[i]);
+		m_statusValues[i] = values[i];
+	}
+	m_hasStatusText = true;
 }
\ No newline at end of file
@@ -3,38 +3,245 @@
 
 #include "GameWorld.h"
 #include "GameConstants.h"
+#include "ActorHandle.h"
+#include "BoardGrid.h"
+#include "Level.h"
 #include <string>
 #include <list>
+#include <vector>
 using namespace std;
 
 class Actor;
 class Player;
+struct ActorState;
+
+//Scrambles the bits of a 64-bit value (the splitmix64 finalizer), used to build state hashes
+inline unsigned long long mixHash(unsigned long long x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+//What an actor decided to do in a tick of the two-phase mode. All actors plan against the world as
+//it was at the start of the tick, then the world carries their intents out in tick order.
+struct Intent
+{
+	enum Type { none, move, turn, fire, munch, spawn };
+
+	Type			type;
+	int				x;
+	int				y;
+	int				direction;
+	int				value;		//meaning depends on the type of the actor
+	ActorHandle		target;
+	//Only changes the actor itself and the lists of the fields it is on and moves to, so it can be
+	//carried out at the same time as other local intents in other regions of the board
+	bool			isLocal;
+};
+
+//Actors plan in batches of this many per task
+const size_t INTENT_BATCH_SIZE = 256;
+
+//Local intents further than this many fields from the border of their chunk are carried out by
+//one thread per chunk, all others are handed off to be carried out one after another afterwards
+const int REGION_HALO = 1;
+
+//Large boards are split into square chunks of this many fields in each direction
+const int CHUNK_SIZE = 32;
+//Chunks at most this many chunks away from the player's chunk are ticked every tick
+const int ACTIVE_CHUNK_RADIUS = 1;
+//Chunks further away, up to this radius, are only ticked every COARSE_TICK_INTERVAL ticks
+const int COARSE_CHUNK_RADIUS = 4;
+const int COARSE_TICK_INTERVAL = 4;
+//Resident chunks kept when the GameWorld does not set a limit
+const unsigned int DEFAULT_RESIDENT_CHUNKS = 256;
 
 class StudentWorld : public GameWorld
 {
 public:
 	StudentWorld(string assetDir)
-		: GameWorld(assetDir), m_player(nullptr), m_actors(), m_bonus(1000), m_isLevelCompleted(false) { }
+		: GameWorld(assetDir), m_player(), m_restoredHandle(), m_slots(), m_freeSlots(), m_actors(), m_staticActors(), m_exits(),
+		m_grid(), m_nextSequence(0), m_nJewels(0), m_level(assetDir), m_levelLoaded(-1),
+		m_chunks(), m_nChunksX(0), m_nChunksY(0), m_nResidentChunks(0), m_nJewelsElsewhere(0), m_centerChunkX(0), m_centerChunkY(0), m_nTicks(0),
+		m_streamSeed(0), m_actingId(0), m_nChildren(0), m_planningActors(), m_intents(),
+		m_regionIntents(), m_handedOffIntents(), m_regionHashes(), m_isResolvingRegions(false),
+		m_bonus(1000), m_isLevelCompleted(false), m_actorHash(0), m_statusText(), m_hasStatusText(false) { }
 	~StudentWorld();
 
 	virtual int init();
 	virtual int move();
 	virtual void cleanUp();
-	
+	virtual unsigned long long getStateHash() const;
+	virtual void getGraphObjectsIn(int x0, int y0, int x1, int y1, vector<GraphObject*>& objects);
+	virtual GraphObject* getCameraTarget();
+	virtual const string& getGameStatText() const;
+
 	Player* getPlayer() const;
+	ActorHandle getPlayerHandle() const;
 	list<Actor*> getActorsAt(int x, int y);
-	
+
+	//Resolve a handle in O(1), returns nullptr if the actor it referred to does not exist anymore
+	Actor* getActor(ActorHandle handle) const
+	{
+		if (handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+			return nullptr;
+		return m_slots[handle.index].actor;
+	}
+
 	void insertActor(Actor* actor);
 	void setLevelCompleted();
 
+	//Serialise the complete state of the running level into one contiguous binary blob,
+	//reusing the memory blob already holds, and recreate that exact state from such a blob
+	virtual void snapshot(vector<char>& blob) const;
+	virtual bool restore(const vector<char>& blob);
+
+	//Only used by Actor's constructor and destructor to give every actor its handle
+	ActorHandle registerActor(Actor* actor);
+	void unregisterActor(ActorHandle handle);
+
+	//Only used by Actor::moveTo to keep the actor in the list of the field it moved to
+	void actorMoved(Actor* actor, int oldX, int oldY);
+
+	bool isOnBoard(int x, int y) const
+	{
+		return m_grid.contains(x, y);
+	}
+
+	//Number of KleptoBots at most radius fields away from x, y in both directions
+	int countKleptoBotsNear(int x, int y, int radius) const;
+
+	//Random number in [0, limit) for the drawIndex-th draw of an actor in the current tick of the
+	//two-phase mode. It only depends on the level's seed, the tick, the actor's id and the index,
+	//never on which thread plans in which order or how many numbers other actors drew.
+	int randIntFor(const Actor* actor, int drawIndex, int limit) const;
+
+	//Every actor XORs its own key in and out of the state hash whenever it changes. While regions
+	//are resolved in parallel, each thread collects its changes separately.
+	void toggleStateHash(unsigned long long key)
+	{
+		if (!m_isResolvingRegions)
+			m_actorHash ^= key;
+		else
+			toggleRegionHash(key);
+	}
+
 private:
+	//The numbers in the status line, in the order they appear
+	enum StatusField { status_score, status_level, status_lives, status_health, status_ammo, status_bonus, nStatusFields };
+
 	void setDisplayText();
+	void layOutStatusText(const long long values[nStatusFields]);
+	int checkLevelStatus();
+	void startActing(const Actor* actor);
+	int moveActorsInTwoPhases();
+	int resolveInRegions();
+	bool isInRegionInterior(int x, int y, int region) const;
+	void toggleRegionHash(unsigned long long key);
+	bool loadLevelFile(unsigned int levelNumber, Level::LoadResult& result);
+	Actor* createActor(Level::MazeEntry entry, int x, int y);
+	Actor* createActor(const ActorState& state, bool keepHandle);
+	void addActor(Actor* actor);
+	void linkToCell(unsigned int slot, int x, int y);
+	void unlinkFromCell(unsigned int slot, int x, int y);
+
+	void resetBoard(int width, int height);
+
+	unsigned int* getCell(int x, int y)
+	{
+		return m_grid.getCell(x, y);
+	}
+
+	template<class Visitor>
+	void forEachCell(int x0, int y0, int x1, int y1, Visitor visit) const
+	{
+		m_grid.forEachCell(x0, y0, x1, y1, visit);
+	}
+
+	void setUpChunks(int& playerX, int& playerY);
+	void updateResidentChunks();
+	void loadChunk(int chunkX, int chunkY);
+	void evictChunk(int chunkX, int chunkY);
+
+	//Actors in chunks near the player act every tick, those a bit further away only every few
+	//ticks and the rest not at all. On boards small enough for one chunk all act every tick.
+	bool isActingThisTick(const Actor* actor) const;
 
 private:
-	Player* m_player;
-	list<Actor*> m_actors;
+	struct ActorSlot
+	{
+		Actor* actor;
+		unsigned int generation;
+		//The actors on one field form a list through their slots, sorted by sequence number from
+		//the newest to the oldest actor, which is the order they act in during a tick
+		unsigned int nextInCell;
+		unsigned int sequence;
+		bool isInCell;
+	};
+
+	ActorHandle m_player;
+	ActorHandle m_restoredHandle;
+	vector<ActorSlot> m_slots;
+	vector<unsigned int> m_freeSlots;
+	//Handles of all actors except the player in reverse tick order, so the actor that is asked to
+	//do something first is at the back and newly inserted actors can simply be appended
+	vector<ActorHandle> m_actors;
+	//Actors that never do anything are kept out of the tick, so it only costs time per active actor
+	vector<ActorHandle> m_staticActors;
+	vector<ActorHandle> m_exits;
+	//First slot of the list of actors on each field, the player is not part of any list
+	BoardGrid m_grid;
+	unsigned int m_nextSequence;
+	int m_nJewels;
+
+	//The level file stays mapped while the level runs, chunks that were never resident are still
+	//only in there. Chunks that were evicted keep their actors as ActorStates.
+	struct Chunk
+	{
+		enum State { unloaded, resident, stored };
+
+		State state;
+		int nJewels;						//while not resident
+		unsigned long long hash;			//state hash contribution of its actors while stored
+		vector<char> actors;				//while stored, ActorStates from the oldest to the newest actor
+	};
+
+	Level m_level;
+	int m_levelLoaded;
+	vector<Chunk> m_chunks;
+	int m_nChunksX;
+	int m_nChunksY;
+	unsigned int m_nResidentChunks;
+	int m_nJewelsElsewhere;
+	int m_centerChunkX;
+	int m_centerChunkY;
+	unsigned int m_nTicks;
+	//Two-phase tick: every actor draws from its own counter-based stream, and new actors get ids
+	//derived from the actor that created them, so ids do not depend on the order of creation
+	unsigned long long m_streamSeed;
+	unsigned long long m_actingId;
+	unsigned int m_nChildren;
+	vector<Actor*> m_planningActors;
+	vector<Intent> m_intents;
+	//Indices into m_planningActors per chunk, and the ones handed off, all in tick order
+	vector<vector<size_t> > m_regionIntents;
+	vector<size_t> m_handedOffIntents;
+	vector<unsigned long long> m_regionHashes;
+	bool m_isResolvingRegions;
 	int m_bonus;
 	bool m_isLevelCompleted;
+	unsigned long long m_actorHash;
+	//The status line stays between ticks, with where each number is in it and how wide it is, so
+	//only the numbers that changed are written into it again
+	string m_statusText;
+	bool m_hasStatusText;
+	long long m_statusValues[nStatusFields];
+	size_t m_statusPositions[nStatusFields];
+	size_t m_statusWidths[nStatusFields];
 };
 
 #endif // STUDENTWORLD_H_
\ No newline at end of file
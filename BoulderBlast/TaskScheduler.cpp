@@ -0,0 +1,248 @@
+#include "TaskScheduler.h"
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+	//The scheduler and queue the current thread works on, if it is one of the workers
+	THREAD_LOCAL TaskScheduler* t_scheduler = nullptr;
+	THREAD_LOCAL int t_workerIndex = -1;
+
+	unsigned int g_sharedThreadCount = 0;
+	once_flag g_sharedOnce;
+	TaskScheduler* g_shared = nullptr;
+}
+
+TaskScheduler::TaskScheduler(unsigned int nThreads)
+	: m_queues(), m_threads(), m_nQueued(0), m_nUnfinished(0), m_nextQueue(0), m_stop(false)
+{
+	if (nThreads == 0)
+		nThreads = thread::hardware_concurrency();
+	if (nThreads == 0)
+		nThreads = 1;
+
+	for (unsigned int i = 0; i < nThreads; i++)
+		m_queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue));
+	resetStats();
+	for (unsigned int i = 0; i < nThreads; i++)
+		m_threads.push_back(thread(&TaskScheduler::workerLoop, this, i));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	//Let the workers finish whatever is still queued, then stop them
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+	m_wakeUp.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+}
+
+TaskScheduler& TaskScheduler::getShared()
+{
+	//Never deleted, workers may still be sleeping in it while the program exits
+	call_once(g_sharedOnce, []() { g_shared = new TaskScheduler(g_sharedThreadCount); });
+	return *g_shared;
+}
+
+void TaskScheduler::setSharedThreadCount(unsigned int nThreads)
+{
+	g_sharedThreadCount = nThreads;
+}
+
+void TaskScheduler::submit(const function<void()>& task)
+{
+	submit(task, nullptr);
+}
+
+void TaskScheduler::submit(const function<void()>& task, TaskGroup* group)
+{
+	//Workers keep their own tasks, everybody else spreads them over all queues
+	int ownQueue = (t_scheduler == this) ? t_workerIndex : -1;
+	unsigned int queue = ownQueue >= 0 ? ownQueue : m_nextQueue++ % m_queues.size();
+
+	m_nUnfinished++;
+	if (group != nullptr)
+		group->m_nUnfinished++;
+	{
+		lock_guard<mutex> lock(m_queues[queue]->mutex);
+		Task entry;
+		entry.function = task;
+		entry.group = group;
+		m_queues[queue]->tasks.push_back(entry);
+	}
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_nQueued++;
+	}
+	m_wakeUp.notify_one();
+}
+
+void TaskScheduler::wait()
+{
+	waitUntil([this]() { return m_nUnfinished == 0; });
+}
+
+void TaskScheduler::waitUntil(const function<bool()>& isDone)
+{
+	int ownQueue = (t_scheduler == this) ? t_workerIndex : -1;
+	while (!isDone())
+	{
+		//Help out instead of just blocking
+		if (runOneTask(ownQueue))
+			continue;
+
+		unique_lock<mutex> lock(m_sleepMutex);
+		m_allDone.wait(lock, [this, &isDone]() { return isDone() || m_nQueued > 0; });
+	}
+}
+
+void TaskScheduler::parallelFor(size_t first, size_t last, size_t grainSize, const function<void(size_t, size_t)>& body)
+{
+	if (grainSize == 0)
+		grainSize = 1;
+
+	//A single range is not worth handing to another thread
+	if (last - first <= grainSize)
+	{
+		if (first < last)
+			body(first, last);
+		return;
+	}
+
+	TaskGroup group(*this);
+	for (size_t begin = first; begin < last; begin += grainSize)
+	{
+		size_t end = min(begin + grainSize, last);
+		group.run([&body, begin, end]() { body(begin, end); });
+	}
+	group.wait();
+}
+
+unsigned int TaskScheduler::getThreadCount() const
+{
+	return static_cast<unsigned int>(m_threads.size());
+}
+
+void TaskScheduler::getStats(vector<WorkerStats>& stats) const
+{
+	stats.resize(m_queues.size());
+	for (size_t i = 0; i < m_queues.size(); i++)
+	{
+		stats[i].nTasks = m_queues[i]->nTasks;
+		stats[i].nStolen = m_queues[i]->nStolen;
+		stats[i].busyNanoseconds = m_queues[i]->busyNanoseconds;
+	}
+}
+
+void TaskScheduler::resetStats()
+{
+	for (size_t i = 0; i < m_queues.size(); i++)
+	{
+		m_queues[i]->nTasks = 0;
+		m_queues[i]->nStolen = 0;
+		m_queues[i]->busyNanoseconds = 0;
+	}
+}
+
+void TaskScheduler::workerLoop(unsigned int index)
+{
+	t_scheduler = this;
+	t_workerIndex = static_cast<int>(index);
+
+	while (true)
+	{
+		if (runOneTask(t_workerIndex))
+			continue;
+
+		//Sleep until there is something to do
+		unique_lock<mutex> lock(m_sleepMutex);
+		m_wakeUp.wait(lock, [this]() { return m_stop || m_nQueued > 0; });
+		if (m_stop && m_nQueued == 0)
+			return;
+	}
+}
+
+bool TaskScheduler::runOneTask(int ownQueue)
+{
+	Task task;
+	bool wasStolen;
+	if (!popTask(ownQueue, task, wasStolen))
+		return false;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	task.function();
+
+	//Only the workers' own time counts, threads that help out while waiting have no queue
+	if (ownQueue >= 0)
+	{
+		WorkerQueue& queue = *m_queues[ownQueue];
+		queue.nTasks++;
+		if (wasStolen)
+			queue.nStolen++;
+		queue.busyNanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+	}
+
+	//Wake up everybody waiting, if this was the last task of its group or of all. The group may
+	//be gone as soon as its counter reaches 0, so it must not be touched after that.
+	bool isGroupDone = task.group != nullptr && --task.group->m_nUnfinished == 0;
+	if (--m_nUnfinished == 0 || isGroupDone)
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_allDone.notify_all();
+	}
+	return true;
+}
+
+bool TaskScheduler::popTask(int ownQueue, Task& task, bool& wasStolen)
+{
+	//Newest task of the own queue first, it is the most likely to still be in the cache
+	wasStolen = false;
+	if (ownQueue >= 0)
+	{
+		WorkerQueue& queue = *m_queues[ownQueue];
+		lock_guard<mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			m_nQueued--;
+			return true;
+		}
+	}
+
+	//Otherwise steal the oldest task of another queue
+	size_t nQueues = m_queues.size();
+	size_t start = ownQueue >= 0 ? ownQueue + 1 : m_nextQueue.load();
+	for (size_t i = 0; i < nQueues; i++)
+	{
+		size_t index = (start + i) % nQueues;
+		if (static_cast<int>(index) == ownQueue)
+			continue;
+
+		WorkerQueue& queue = *m_queues[index];
+		lock_guard<mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			m_nQueued--;
+			wasStolen = ownQueue >= 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskGroup::run(const function<void()>& task)
+{
+	m_scheduler.submit(task, this);
+}
+
+void TaskGroup::wait()
+{
+	m_scheduler.waitUntil([this]() { return m_nUnfinished == 0; });
+}
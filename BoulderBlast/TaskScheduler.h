@@ -0,0 +1,122 @@
+#ifndef TASKSCHEDULER_H_
+#define TASKSCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+//Storage class for variables of which every thread has its own copy
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+class TaskGroup;
+
+//Thread pool in which every worker has its own deque of tasks. A worker takes its newest task
+//from the back of its own deque, and when that is empty, steals the oldest task from the front of
+//another worker's deque. Tasks submitted from inside a task go to the submitting worker's deque.
+//Everything in the game that runs in parallel shares the one returned by getShared().
+class TaskScheduler
+{
+public:
+	//What one worker has done since the scheduler started or its statistics were last reset
+	struct WorkerStats
+	{
+		unsigned long long	nTasks;
+		unsigned long long	nStolen;			//tasks taken from another worker's deque
+		unsigned long long	busyNanoseconds;
+	};
+
+	//nThreads of 0 uses one worker per hardware thread
+	explicit TaskScheduler(unsigned int nThreads = 0);
+	~TaskScheduler();
+
+	//The scheduler shared by the whole game, started on first use with the number of threads
+	//set before that, by default one per hardware thread
+	static TaskScheduler& getShared();
+	static void setSharedThreadCount(unsigned int nThreads);
+
+	void submit(const std::function<void()>& task);
+
+	//Blocks until every task submitted so far has finished, running tasks itself in the meantime
+	void wait();
+
+	//Calls body(begin, end) for consecutive ranges of at most grainSize indices from first to
+	//last, in parallel, and returns once all of them are done
+	void parallelFor(size_t first, size_t last, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+
+	unsigned int getThreadCount() const;
+
+	void getStats(std::vector<WorkerStats>& stats) const;
+	void resetStats();
+
+private:
+	friend class TaskGroup;
+
+	struct Task
+	{
+		std::function<void()>	function;
+		TaskGroup*				group;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex							mutex;
+		std::deque<Task>					tasks;
+		std::atomic<unsigned long long>		nTasks;
+		std::atomic<unsigned long long>		nStolen;
+		std::atomic<unsigned long long>		busyNanoseconds;
+	};
+
+	void submit(const std::function<void()>& task, TaskGroup* group);
+	void waitUntil(const std::function<bool()>& isDone);
+	void workerLoop(unsigned int index);
+	bool runOneTask(int ownQueue);
+	bool popTask(int ownQueue, Task& task, bool& wasStolen);
+
+	TaskScheduler(const TaskScheduler&);
+	TaskScheduler& operator=(const TaskScheduler&);
+
+private:
+	std::vector<std::unique_ptr<WorkerQueue> >	m_queues;
+	std::vector<std::thread>					m_threads;
+	std::mutex									m_sleepMutex;
+	std::condition_variable						m_wakeUp;
+	std::condition_variable						m_allDone;
+	std::atomic<int>							m_nQueued;
+	std::atomic<int>							m_nUnfinished;
+	std::atomic<unsigned int>					m_nextQueue;
+	bool										m_stop;
+};
+
+//A set of tasks that can be waited for on their own, while other users of the same scheduler
+//keep their tasks running. Waiting runs tasks of the scheduler instead of just blocking, so
+//tasks may start groups of their own and wait for them.
+class TaskGroup
+{
+public:
+	explicit TaskGroup(TaskScheduler& scheduler) : m_scheduler(scheduler), m_nUnfinished(0) {}
+	~TaskGroup() { wait(); }
+
+	void run(const std::function<void()>& task);
+	void wait();
+
+private:
+	friend class TaskScheduler;
+
+	TaskGroup(const TaskGroup&);
+	TaskGroup& operator=(const TaskGroup&);
+
+private:
+	TaskScheduler&		m_scheduler;
+	std::atomic<int>	m_nUnfinished;
+};
+
+#endif // TASKSCHEDULER_H_
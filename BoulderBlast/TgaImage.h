@@ -0,0 +1,72 @@
+#ifndef TGAIMAGE_H_
+#define TGAIMAGE_H_
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+  // A decoded TGA file, BGRA with 4 bytes per pixel, rows from the bottom to the top
+struct SpriteImage
+{
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> pixels;
+
+	SpriteImage()
+	 : width(0), height(0)
+	{
+	}
+};
+
+  // Reads an uncompressed colour (type 2) or greyscale (type 3) TGA file with 24 or
+  // 32 bits per pixel, anything else is refused
+inline bool loadTga(const std::string& filename_tga, SpriteImage& image)
+{
+	std::ifstream tgaFile (filename_tga, std::ios::in|std::ios::binary);
+	if (!tgaFile)
+		return false;
+
+	char type[3];
+	char info[6];
+
+		// Read file header info
+	tgaFile.read(type, 3);
+	tgaFile.seekg(12);
+	tgaFile.read(info, 6);
+	if (!tgaFile)
+		return false;
+
+		// image type either 2 (color) or 3 (greyscale)
+	if (type[1] != 0 || (type[2] != 2 && type[2] != 3))
+		return false;
+
+	unsigned int width = static_cast<unsigned char>(info[0]) + static_cast<unsigned char>(info[1]) * 256;
+	unsigned int height = static_cast<unsigned char>(info[2]) + static_cast<unsigned char>(info[3]) * 256;
+	unsigned int byteCount = static_cast<unsigned char>(info[4]) / 8;
+	if (byteCount != 3 && byteCount != 4)
+		return false;
+
+		// Read image data
+	std::vector<char> fileData(width * height * byteCount);
+	tgaFile.seekg(18);
+	if (!fileData.empty())
+		tgaFile.read(&fileData[0], fileData.size());
+	if (!tgaFile)
+		return false;
+
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(width * height * 4);
+	for (unsigned int k = 0; k < width * height; k++)
+	{
+		const char* from = &fileData[k * byteCount];
+		unsigned char* to = &image.pixels[k * 4];
+		to[0] = static_cast<unsigned char>(from[0]);
+		to[1] = static_cast<unsigned char>(from[1]);
+		to[2] = static_cast<unsigned char>(from[2]);
+		to[3] = (byteCount == 4 ? static_cast<unsigned char>(from[3]) : 255);
+	}
+	return true;
+}
+
+#endif // TGAIMAGE_H_
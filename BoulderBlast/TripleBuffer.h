@@ -0,0 +1,61 @@
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+
+#include <atomic>
+
+  // Hands values from one writer thread to one reader thread without either ever
+  // waiting for the other. The writer fills its own buffer and publishes it, the
+  // reader picks up the most recently published one; values published in between
+  // are skipped. Both only ever swap their buffer with the shared middle one, in a
+  // single atomic exchange that also carries whether the middle one is new.
+template<class T>
+class TripleBuffer
+{
+  public:
+	TripleBuffer()
+	 : m_middle(1), m_writeIndex(0), m_readIndex(2)
+	{
+	}
+
+	  // Writer side: fill the buffer returned here, then publish it
+	T& getWriteBuffer()
+	{
+		return m_buffers[m_writeIndex];
+	}
+
+	void publish()
+	{
+		unsigned int old = m_middle.exchange(m_writeIndex | FRESH, std::memory_order_acq_rel);
+		m_writeIndex = old & INDEX_MASK;
+	}
+
+	  // Reader side: switch to the newest published buffer, if there is one the reader
+	  // has not seen yet, and return whether it did
+	bool update()
+	{
+		if ((m_middle.load(std::memory_order_acquire) & FRESH) == 0)
+			return false;
+		unsigned int old = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+		m_readIndex = old & INDEX_MASK;
+		return true;
+	}
+
+	const T& getReadBuffer() const
+	{
+		return m_buffers[m_readIndex];
+	}
+
+  private:
+	enum { INDEX_MASK = 3, FRESH = 4 };
+
+	T							m_buffers[3];
+	std::atomic<unsigned int>	m_middle;
+	unsigned int				m_writeIndex;
+	unsigned int				m_readIndex;
+
+	  // Prevent copying or assigning TripleBuffers
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+};
+
+#endif // TRIPLEBUFFER_H_
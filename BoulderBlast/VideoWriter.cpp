@@ -0,0 +1,160 @@
+#include "VideoWriter.h"
+using namespace std;
+
+VideoWriter::VideoWriter()
+	: m_file(), m_width(0), m_height(0), m_maxQueuedFrames(0), m_nFrames(0), m_queue(), m_freeBuffers(),
+	m_isClosing(false), m_hasFailed(false), m_writer(), m_yuv()
+{
+}
+
+VideoWriter::~VideoWriter()
+{
+	close();
+}
+
+bool VideoWriter::open(const string& filename, unsigned int width, unsigned int height,
+	unsigned int framesPerSecond, unsigned int frameRateDivisor, size_t maxQueuedFrames)
+{
+	close();
+
+	//4:2:0 needs an even size
+	if (width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0)
+		return false;
+
+	m_file.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!m_file)
+		return false;
+
+	//Progressive, square pixels, full range BT.601 colours. Without XCOLORRANGE players assume
+	//limited range and clip the blacks and whites.
+	m_file << "YUV4MPEG2 W" << width << " H" << height << " F" << framesPerSecond << ':' << frameRateDivisor
+		   << " Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+	m_width = width;
+	m_height = height;
+	m_maxQueuedFrames = maxQueuedFrames > 0 ? maxQueuedFrames : 1;
+	m_nFrames = 0;
+	m_isClosing = false;
+	m_hasFailed = !m_file;
+	m_writer = thread(&VideoWriter::writerLoop, this);
+	return !m_hasFailed;
+}
+
+bool VideoWriter::addFrame(const vector<unsigned char>& bgra)
+{
+	unique_lock<mutex> lock(m_mutex);
+	if (!m_writer.joinable() || m_hasFailed || bgra.size() != m_width * m_height * 4)
+		return false;
+
+	m_frameWritten.wait(lock, [this]() { return m_queue.size() < m_maxQueuedFrames || m_hasFailed; });
+	if (m_hasFailed)
+		return false;
+
+	//Reuse the memory of a frame that was already written
+	m_queue.push_back(vector<unsigned char>());
+	if (!m_freeBuffers.empty())
+	{
+		m_queue.back().swap(m_freeBuffers.back());
+		m_freeBuffers.pop_back();
+	}
+	m_queue.back().assign(bgra.begin(), bgra.end());
+	m_nFrames++;
+	m_frameAdded.notify_one();
+	return true;
+}
+
+bool VideoWriter::close()
+{
+	if (!m_writer.joinable())
+		return !m_hasFailed;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isClosing = true;
+	}
+	m_frameAdded.notify_one();
+	m_writer.join();
+
+	m_file.close();
+	m_queue.clear();
+	m_freeBuffers.clear();
+	return !m_hasFailed;
+}
+
+void VideoWriter::writerLoop()
+{
+	vector<unsigned char> frame;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			if (!frame.empty())
+			{
+				m_freeBuffers.push_back(vector<unsigned char>());
+				m_freeBuffers.back().swap(frame);
+			}
+
+			m_frameAdded.wait(lock, [this]() { return !m_queue.empty() || m_isClosing; });
+			if (m_queue.empty())
+				return;
+			frame.swap(m_queue.front());
+			m_queue.pop_front();
+			m_frameWritten.notify_one();
+		}
+
+		//Conversion and writing happen outside the lock, so addFrame can queue the next frame
+		writeFrame(frame);
+		if (!m_file)
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_hasFailed = true;
+			m_queue.clear();
+			m_frameWritten.notify_all();
+		}
+	}
+}
+
+void VideoWriter::writeFrame(const vector<unsigned char>& bgra)
+{
+	//Full range BT.601 in fixed point with 16 fractional bits: the Y plane, then U and V with one
+	//sample for each 2 x 2 block of pixels
+	const unsigned int planeSize = m_width * m_height;
+	const unsigned int chromaWidth = m_width / 2;
+	const unsigned int chromaSize = planeSize / 4;
+	m_yuv.resize(planeSize + 2 * chromaSize);
+	char* yPlane = &m_yuv[0];
+	char* uPlane = yPlane + planeSize;
+	char* vPlane = uPlane + chromaSize;
+
+	for (unsigned int y = 0; y < m_height; y++)
+	{
+		const unsigned char* row = &bgra[y * m_width * 4];
+		for (unsigned int x = 0; x < m_width; x++)
+		{
+			const unsigned char* p = row + x * 4;
+			int luma = (19595 * p[2] + 38470 * p[1] + 7471 * p[0] + 32768) >> 16;
+			yPlane[y * m_width + x] = static_cast<char>(luma);
+		}
+	}
+
+	for (unsigned int y = 0; y < m_height; y += 2)
+	{
+		const unsigned char* top = &bgra[y * m_width * 4];
+		const unsigned char* bottom = top + m_width * 4;
+		for (unsigned int x = 0; x < m_width; x += 2)
+		{
+			int b = top[x * 4] + top[x * 4 + 4] + bottom[x * 4] + bottom[x * 4 + 4];
+			int g = top[x * 4 + 1] + top[x * 4 + 5] + bottom[x * 4 + 1] + bottom[x * 4 + 5];
+			int r = top[x * 4 + 2] + top[x * 4 + 6] + bottom[x * 4 + 2] + bottom[x * 4 + 6];
+
+			//Sums of 4 pixels, so the offset of 128 and the rounding are 4 times as large too
+			int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18;
+			int v = (32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18;
+			unsigned int at = (y / 2) * chromaWidth + x / 2;
+			uPlane[at] = static_cast<char>(u < 0 ? 0 : (u > 255 ? 255 : u));
+			vPlane[at] = static_cast<char>(v < 0 ? 0 : (v > 255 ? 255 : v));
+		}
+	}
+
+	m_file.write("FRAME\n", 6);
+	m_file.write(&m_yuv[0], m_yuv.size());
+}
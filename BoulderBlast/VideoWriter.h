@@ -0,0 +1,63 @@
+#ifndef VIDEOWRITER_H_
+#define VIDEOWRITER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Writes frames into a YUV4MPEG2 (.y4m) video file, which every video tool reads. Frames are only
+//copied into a queue by addFrame, a thread of the writer's own converts them to YUV 4:2:0 and
+//writes them, so the caller never waits for the disk. Only when the disk cannot keep up and the
+//queue is full does addFrame wait for a free place, no frame is ever dropped.
+class VideoWriter
+{
+public:
+	VideoWriter();
+	~VideoWriter();
+
+	//Frames are width x height BGRA pixels, rows from the top to the bottom. The frame rate is
+	//framesPerSecond / frameRateDivisor.
+	bool open(const std::string& filename, unsigned int width, unsigned int height,
+		unsigned int framesPerSecond, unsigned int frameRateDivisor = 1, size_t maxQueuedFrames = 8);
+
+	//Returns false once writing failed, the frame is not written then
+	bool addFrame(const std::vector<unsigned char>& bgra);
+
+	//Writes all queued frames and closes the file, returns whether all were written
+	bool close();
+
+	unsigned long long getFrameCount() const { return m_nFrames; }
+
+private:
+	void writerLoop();
+	void writeFrame(const std::vector<unsigned char>& bgra);
+
+	VideoWriter(const VideoWriter&);
+	VideoWriter& operator=(const VideoWriter&);
+
+private:
+	std::ofstream m_file;
+	unsigned int m_width;
+	unsigned int m_height;
+	size_t m_maxQueuedFrames;
+	unsigned long long m_nFrames;
+
+	//Frames waiting to be written, and buffers of written frames to be reused for new ones
+	std::deque<std::vector<unsigned char> > m_queue;
+	std::vector<std::vector<unsigned char> > m_freeBuffers;
+	std::mutex m_mutex;
+	std::condition_variable m_frameAdded;
+	std::condition_variable m_frameWritten;
+	bool m_isClosing;
+	bool m_hasFailed;
+	std::thread m_writer;
+
+	//Only used by the writer thread
+	std::vector<char> m_yuv;
+};
+
+#endif // VIDEOWRITER_H_
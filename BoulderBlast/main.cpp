@@ -1,10 +1,20 @@
 #include "glut.h"
 #include "GameController.h"
+#include "GameWorld.h"
+#include "Replay.h"
+#include "Level.h"
+#include "Solver.h"
+#include "TaskScheduler.h"
+#include "AssetBundle.h"
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <fstream>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <chrono>
 using namespace std;
 
   // If your program is having trouble finding the Assets directory,
@@ -17,12 +27,215 @@ class GameWorld;
 
 GameWorld* createStudentWorld(string assetDir = "");
 
+  // Runs each replay file without graphics and reports its final score and state hash.
+  // Returns the number of replays that could not be run or did not match their recording.
+  // One replay runs at a few hundred thousand ticks per second on one thread, fewer the
+  // more robots there are (about 190,000 with some forty of them); the batch scales with
+  // the number of workers, since each replay runs on one.
+static int runReplays(const vector<string>& files, const string& frameDirectory, const string& videoDirectory,
+					  unsigned int frameStep, unsigned int restoreCheckInterval)
+{
+	  // every replay has its own world and controller, so they all run at once,
+	  // and the reports are printed in the order of the files afterwards
+	vector<string> reports(files.size());
+	vector<char> failed(files.size(), 0);
+	TaskScheduler::getShared().parallelFor(0, files.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			ostringstream report;
+			Replay replay;
+			if (!replay.load(files[i]))
+			{
+				report << files[i] << ": cannot read replay file";
+				reports[i] = report.str();
+				failed[i] = 1;
+				continue;
+			}
+
+			  // frames and videos of each replay are named after its file, e.g. run-000042.ppm
+			  // and run.y4m
+			GameController controller;
+			string name = files[i].substr(files[i].find_last_of("/\\") + 1);
+			name = name.substr(0, name.find_last_of('.'));
+			if (!frameDirectory.empty())
+				controller.renderFrames(frameDirectory + "/" + name + "-");
+			if (!videoDirectory.empty())
+				controller.captureVideo(videoDirectory + "/" + name + ".y4m");
+			controller.setFrameStep(frameStep);
+			controller.checkRestore(restoreCheckInterval);
+			GameWorld* gw = createStudentWorld(assetDirectory);
+			ReplayResult result;
+			bool completed = controller.playReplay(gw, replay, result);
+			delete gw;
+
+			report << files[i] << ": ticks " << result.ticks << " score " << result.score
+				   << " hash " << hex << setw(16) << setfill('0') << result.stateHash << dec;
+			if (!completed)
+				report << " INCOMPLETE";
+			else if (replay.hasResult())
+				report << (result.matchesRecording ? " OK" : " MISMATCH");
+			if (!result.restoresMatched)
+				report << " RESTORE MISMATCH";
+			reports[i] = report.str();
+
+			if (!completed || (replay.hasResult() && !result.matchesRecording) || !result.restoresMatched)
+				failed[i] = 1;
+		}
+	});
+
+	int nFailed = 0;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		cout << reports[i] << endl;
+		nFailed += failed[i];
+	}
+	return nFailed;
+}
+
+  // Prints how busy each worker of the shared scheduler was since the given time.
+static void printSchedulerStats(chrono::steady_clock::time_point start)
+{
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	vector<TaskScheduler::WorkerStats> stats;
+	TaskScheduler::getShared().getStats(stats);
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		cout << "worker " << i << ": " << stats[i].nTasks << " tasks, " << stats[i].nStolen << " stolen, "
+			 << fixed << setprecision(1) << (seconds > 0 ? stats[i].busyNanoseconds / 1e7 / seconds : 0.0)
+			 << "% busy" << endl;
+	}
+}
+
+  // Searches each level for a way to collect all jewels and reach the exit, not necessarily
+  // the shortest one.
+  // Without level files, level00.dat, level01.dat, ... are checked until one is missing.
+  // Returns the number of levels that could not be loaded or were not shown to be solvable.
+static int runSolver(vector<string> files)
+{
+	if (files.empty())
+	{
+		for (int k = 0; k <= 99; k++)
+		{
+			ostringstream name;
+			name << "level" << setw(2) << setfill('0') << k << ".dat";
+			if (!ifstream((assetDirectory + "/" + name.str()).c_str()))
+				break;
+			files.push_back(name.str());
+		}
+	}
+
+	TaskScheduler& scheduler = TaskScheduler::getShared();
+	int nFailed = 0;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		Level level(assetDirectory);
+		if (level.loadLevel(files[i]) != Level::load_success)
+		{
+			cout << files[i] << ": cannot load level" << endl;
+			nFailed++;
+			continue;
+		}
+
+		Solver::Result result = Solver(level).solve(scheduler);
+		cout << files[i] << ": ";
+		if (result.solvable)
+			cout << "solvable with " << result.nSteps << " pushes and shots in " << result.moves.size() << " moves "
+				 << result.moves;
+		else if (result.gaveUp)
+			cout << "undecided";
+		else if (!result.isExact)
+			cout << "undecided, no solution without the robots";
+		else
+			cout << "UNSOLVABLE";
+		cout << " (" << result.nStates << " states)" << endl;
+
+		if (!result.solvable)
+			nFailed++;
+	}
+	return nFailed;
+}
+
 int main(int argc, char* argv[])
 {
+	  // Command line options:
+	  //   --seed <n>                  use a fixed random seed instead of the current time
+	  //   --record <file>             record the keys of this session into a replay file
+	  //   --replay <file> [<file>..]  run replay files without graphics and report the results
+	  //   --frames <dir>              with --replay, also write every frame into dir as PPM files
+	  //   --video <dir>               with --replay, also write every frame into a Y4M video in dir
+	  //   --frame-step <n>            only write every nth frame with --frames or --video
+	  //   --check-restore <n>         with --replay, snapshot and restore the world every n ticks
+	  //                               and check that it stays the same
+	  //   --solve [<file>..]          check that levels can be solved and print a solution, 'F' is a shot
+	  //   --resident-chunks <n>       keep at most n chunks of a large level in memory
+	  //   --tick-threads <n>          plan every tick on n threads first, then carry it out
+	  //   --threads <n>               size of the shared job system, one per hardware thread by default
+	  //   --stats                     report how busy the job system was after --replay or --solve
+	  //   --bundle [<file>]           write the sprites, sounds and levels into one asset bundle,
+	  //                               Assets/assets.bundle by default, which the game then loads
+	  //                               at startup instead. Run it again after changing an asset.
+	unsigned long long seed = static_cast<unsigned long long>(time(nullptr));
+	string recordFile;
+	vector<string> replayFiles;
+	string frameDirectory;
+	string videoDirectory;
+	unsigned int frameStep = 1;
+	unsigned int restoreCheckInterval = 0;
+	vector<string> solveFiles;
+	bool solve = false;
+	unsigned int residentChunks = 0;
+	unsigned int tickThreads = 0;
+	unsigned int threads = 0;
+	bool printStats = false;
+	bool writeBundle = false;
+	string bundleFile;
+	for (int k = 1; k < argc; k++)
+	{
+		string arg = argv[k];
+		if (arg == "--seed" && k + 1 < argc)
+			seed = strtoull(argv[++k], nullptr, 10);
+		else if (arg == "--record" && k + 1 < argc)
+			recordFile = argv[++k];
+		else if (arg == "--resident-chunks" && k + 1 < argc)
+			residentChunks = static_cast<unsigned int>(strtoul(argv[++k], nullptr, 10));
+		else if (arg == "--tick-threads" && k + 1 < argc)
+			tickThreads = static_cast<unsigned int>(strtoul(argv[++k], nullptr, 10));
+		else if (arg == "--threads" && k + 1 < argc)
+			threads = static_cast<unsigned int>(strtoul(argv[++k], nullptr, 10));
+		else if (arg == "--frames" && k + 1 < argc)
+			frameDirectory = argv[++k];
+		else if (arg == "--video" && k + 1 < argc)
+			videoDirectory = argv[++k];
+		else if (arg == "--frame-step" && k + 1 < argc)
+			frameStep = static_cast<unsigned int>(strtoul(argv[++k], nullptr, 10));
+		else if (arg == "--check-restore" && k + 1 < argc)
+			restoreCheckInterval = static_cast<unsigned int>(strtoul(argv[++k], nullptr, 10));
+		else if (arg == "--stats")
+			printStats = true;
+		else if (arg == "--replay")
+		{
+			while (k + 1 < argc && argv[k + 1][0] != '-')
+				replayFiles.push_back(argv[++k]);
+		}
+		else if (arg == "--bundle")
+		{
+			writeBundle = true;
+			if (k + 1 < argc && argv[k + 1][0] != '-')
+				bundleFile = argv[++k];
+		}
+		else if (arg == "--solve")
+		{
+			solve = true;
+			while (k + 1 < argc && argv[k + 1][0] != '-')
+				solveFiles.push_back(argv[++k]);
+		}
+	}
+
+	string path = assetDirectory;
+	if (!path.empty())
+		path += '/';
 	{
-		string path = assetDirectory;
-		if (!path.empty())
-			path += '/';
 		ifstream ifs(path + "level00.dat");
 		if (!ifs)
 		{
@@ -33,10 +246,45 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if (writeBundle)
+	{
+		if (bundleFile.empty())
+			bundleFile = path + "assets.bundle";
+		if (!GameController::writeAssetBundle(assetDirectory, bundleFile))
+		{
+			cout << "Cannot write the asset bundle " << bundleFile << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	  // Everything in the bundle is read from it from now on. Without one, or with one
+	  // that cannot be read, each asset is loaded from its own file.
+	AssetBundle::getShared().open(path + "assets.bundle");
+
+	  // the thread that waits for the tick works as well, so it needs one worker less
+	if (threads == 0 && tickThreads > 1)
+		threads = tickThreads - 1;
+	TaskScheduler::setSharedThreadCount(threads);
+
+	if (!replayFiles.empty() || solve)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		int nFailed = !replayFiles.empty() ? runReplays(replayFiles, frameDirectory, videoDirectory, frameStep, restoreCheckInterval) : runSolver(solveFiles);
+		if (printStats)
+			printSchedulerStats(start);
+		return nFailed == 0 ? 0 : 1;
+	}
+
     glutInit(&argc, argv);
 
     srand(static_cast<unsigned int>(time(nullptr)));
 
     GameWorld* gw = createStudentWorld(assetDirectory);
+    gw->setRandomSeed(seed);
+    gw->setResidentChunkLimit(residentChunks);
+    gw->setTickThreads(tickThreads);
+    if (!recordFile.empty())
+        Game().recordReplay(recordFile);
     Game().run(gw, "Boulder Blast");
 }